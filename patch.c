@@ -1,3 +1,6 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -19,18 +22,214 @@ typedef enum {
     LOG_ERROR
 } log_level_t;
 
+#define LOGGER_MAX_SITES 64
+
 typedef struct {
     FILE* output;
     log_level_t min_level;
+    int binary;
+    int anchored;
+    const char* sites[LOGGER_MAX_SITES];
+    size_t site_count;
 } logger_t;
 
 void logger_init(logger_t* logger, FILE* output, log_level_t min_level) {
+    memset(logger, 0, sizeof(*logger));
     logger->output = output;
     logger->min_level = min_level;
 }
 
+// Binary records use the layout documented above Logger in propatch.cpp;
+// decode them with port_logdecode.
+void logger_set_binary(logger_t* logger, int binary) {
+    logger->binary = binary;
+}
+
+static int64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void put_string(FILE* out, const char* text, int wide) {
+    size_t len = strlen(text);
+    if (wide) {
+        uint32_t n = (uint32_t)len;
+        fwrite(&n, sizeof(n), 1, out);
+    } else {
+        uint16_t n = (uint16_t)len;
+        fwrite(&n, sizeof(n), 1, out);
+    }
+    fwrite(text, 1, len, out);
+}
+
+static void put_tagged(FILE* out, char tag, const void* value, size_t size) {
+    fputc(tag, out);
+    fwrite(value, size, 1, out);
+}
+
+static void logger_register_site(logger_t* logger, const char* format) {
+    uint32_t id = (uint32_t)logger->site_count;
+    uint8_t style = 1; // printf
+    uint32_t line = 0;
+    logger->sites[logger->site_count++] = format;
+    fputc('S', logger->output);
+    fwrite(&id, sizeof(id), 1, logger->output);
+    fwrite(&style, sizeof(style), 1, logger->output);
+    fwrite(&line, sizeof(line), 1, logger->output);
+    put_string(logger->output, format, 0);
+    put_string(logger->output, "", 0);
+    put_string(logger->output, "", 0);
+}
+
+// Walks the printf conversions of format, pulling each argument off args.
+// With out == NULL it only counts them; otherwise each is written as a tagged value.
+static unsigned logger_walk_args(FILE* out, const char* format, va_list args) {
+    unsigned count = 0;
+    for (const char* p = format; *p != '\0'; p++) {
+        if (*p != '%') continue;
+        if (*++p == '%') continue;
+
+        while (*p != '\0' && strchr("-+ #0", *p)) p++;
+        for (int part = 0; part < 2; part++) {
+            if (*p == '*') {
+                int64_t value = va_arg(args, int);
+                if (out) put_tagged(out, 'i', &value, sizeof(value));
+                count++;
+                p++;
+            }
+            while (*p >= '0' && *p <= '9') p++;
+            if (part == 0 && *p == '.') p++;
+            else break;
+        }
+
+        char length = 0;
+        if (*p == 'h' || *p == 'l') {
+            length = *p++;
+            if (*p == length) {
+                length = (char)(length == 'l' ? 'q' : 'H');
+                p++;
+            }
+        } else if (*p == 'z' || *p == 'j' || *p == 't' || *p == 'L') {
+            length = *p++;
+        }
+
+        if (*p == '\0') break;
+        switch (*p) {
+            case 'd': case 'i': case 'c': {
+                int64_t value;
+                switch (length) {
+                    case 'l': value = va_arg(args, long); break;
+                    case 'q': value = va_arg(args, long long); break;
+                    case 'z': value = va_arg(args, ssize_t); break;
+                    case 'j': value = va_arg(args, intmax_t); break;
+                    case 't': value = va_arg(args, ptrdiff_t); break;
+                    default: value = va_arg(args, int); break;
+                }
+                if (out) put_tagged(out, 'i', &value, sizeof(value));
+                break;
+            }
+            case 'u': case 'o': case 'x': case 'X': {
+                uint64_t value;
+                switch (length) {
+                    case 'l': value = va_arg(args, unsigned long); break;
+                    case 'q': value = va_arg(args, unsigned long long); break;
+                    case 'z': value = va_arg(args, size_t); break;
+                    case 'j': value = va_arg(args, uintmax_t); break;
+                    case 't': value = (uint64_t)va_arg(args, ptrdiff_t); break;
+                    default: value = va_arg(args, unsigned int); break;
+                }
+                if (out) put_tagged(out, 'u', &value, sizeof(value));
+                break;
+            }
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': {
+                double value = length == 'L' ? (double)va_arg(args, long double) : va_arg(args, double);
+                if (out) put_tagged(out, 'd', &value, sizeof(value));
+                break;
+            }
+            case 's': {
+                const char* value = va_arg(args, const char*);
+                if (out) {
+                    fputc('s', out);
+                    put_string(out, value ? value : "(null)", 1);
+                }
+                break;
+            }
+            case 'p': {
+                uint64_t value = (uint64_t)(uintptr_t)va_arg(args, void*);
+                if (out) put_tagged(out, 'u', &value, sizeof(value));
+                break;
+            }
+            default:
+                (void)va_arg(args, void*);
+                continue;
+        }
+        count++;
+    }
+    return count;
+}
+
+static void logger_log_binary(logger_t* logger, log_level_t level, const char* format, va_list args) {
+    int64_t now = monotonic_ns();
+    FILE* out = logger->output;
+
+    if (!logger->anchored) {
+        struct timespec wall;
+        clock_gettime(CLOCK_REALTIME, &wall);
+        int64_t wall_ns = (int64_t)wall.tv_sec * 1000000000 + wall.tv_nsec;
+        fwrite("PPLOG\x01\0\0", 1, 8, out);
+        fwrite(&wall_ns, sizeof(wall_ns), 1, out);
+        fwrite(&now, sizeof(now), 1, out);
+        logger->anchored = 1;
+        logger_register_site(logger, "%s"); // site 0 carries preformatted overflow messages
+    }
+
+    size_t site = 0;
+    while (site < logger->site_count && logger->sites[site] != format) site++;
+    if (site == logger->site_count && site < LOGGER_MAX_SITES) {
+        logger_register_site(logger, format);
+    }
+
+    uint32_t id;
+    uint8_t level_byte = (uint8_t)level;
+    if (site < logger->site_count) {
+        va_list counting;
+        va_copy(counting, args);
+        uint8_t argc = (uint8_t)logger_walk_args(NULL, format, counting);
+        va_end(counting);
+
+        id = (uint32_t)site;
+        fputc('R', out);
+        fwrite(&id, sizeof(id), 1, out);
+        fwrite(&level_byte, sizeof(level_byte), 1, out);
+        fwrite(&now, sizeof(now), 1, out);
+        fwrite(&argc, sizeof(argc), 1, out);
+        logger_walk_args(out, format, args);
+    } else {
+        char message[4096];
+        uint8_t argc = 1;
+        vsnprintf(message, sizeof(message), format, args);
+        id = 0;
+        fputc('R', out);
+        fwrite(&id, sizeof(id), 1, out);
+        fwrite(&level_byte, sizeof(level_byte), 1, out);
+        fwrite(&now, sizeof(now), 1, out);
+        fwrite(&argc, sizeof(argc), 1, out);
+        fputc('s', out);
+        put_string(out, message, 1);
+    }
+}
+
 void logger_log(logger_t* logger, log_level_t level, const char* format, ...) {
     if (level < logger->min_level) return;
+
+    if (logger->binary) {
+        va_list args;
+        va_start(args, format);
+        logger_log_binary(logger, level, format, args);
+        va_end(args);
+        return;
+    }
     
     time_t now = time(NULL);
     struct tm* tm_info = localtime(&now);
@@ -343,14 +542,26 @@ char* backup_original(port_patcher_t* patcher) {
 int main(int argc, char* argv[]) {
     if (argc < 3) {
         fprintf(stderr, "Usage: %s <port-name> <patch-file> [backup-dir]\n", argv[0]);
+        fprintf(stderr, "Set PORT_PATCHER_LOG_FORMAT=binary for a binary log in /var/log/port_patcher-*.plog (see port_logdecode)\n");
         return EXIT_FAILURE;
     }
     
     // Initialize logging
     logger_t file_logger, console_logger;
-    FILE* log_file = fopen("/var/log/port_patcher.log", "a");
+    // a binary session gets its own file: its site ids mean nothing to other appenders
+    const char* log_format = getenv("PORT_PATCHER_LOG_FORMAT");
+    int binary_log = log_format && strcmp(log_format, "binary") == 0;
+    char log_path[128] = "/var/log/port_patcher.log";
+    if (binary_log) {
+        time_t started = time(NULL);
+        char stamp[32];
+        strftime(stamp, sizeof(stamp), "%Y%m%dT%H%M%S", gmtime(&started));
+        snprintf(log_path, sizeof(log_path), "/var/log/port_patcher-%s-%ld.plog", stamp, (long)getpid());
+    }
+    FILE* log_file = fopen(log_path, binary_log ? "ab" : "a");
     if (log_file) {
         logger_init(&file_logger, log_file, LOG_DEBUG);
+        logger_set_binary(&file_logger, binary_log);
     }
     logger_init(&console_logger, stdout, LOG_INFO);
     
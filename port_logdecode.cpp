@@ -0,0 +1,345 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <expected>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <print>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+namespace fs = std::filesystem;
+using namespace std::chrono;
+using namespace std::string_literals;
+using namespace std::string_view_literals;
+
+// turns the binary logs written by `propatch --binary-log` (and patch.c with
+// PORT_PATCHER_LOG_FORMAT=binary), one /var/log/port_patcher-*.plog per session, back into the
+// text format of the text loggers; the record layout is documented above Logger in propatch.cpp
+
+using Argument = std::variant<std::int64_t, std::uint64_t, double, bool, std::string>;
+
+struct Site {
+    std::uint8_t style; // 0 std::format, 1 printf
+    std::uint32_t line;
+    std::string format;
+    std::string file;
+    std::string function;
+};
+
+// argument conversion
+
+template <typename T>
+[[nodiscard]] T argument_as(const Argument& argument) {
+    return std::visit([](const auto& value) -> T {
+        using V = std::remove_cvref_t<decltype(value)>;
+        if constexpr (std::is_same_v<T, std::string>) {
+            if constexpr (std::is_same_v<V, std::string>) return value;
+            else return std::format("{}", value);
+        } else if constexpr (std::is_same_v<V, std::string>) {
+            return T{};
+        } else {
+            return static_cast<T>(value);
+        }
+    }, argument);
+}
+
+/* one std::format replacement field applied to a decoded argument; a spec that does not fit
+ * the decoded type (the logger formatted that argument eagerly) falls back to "{}" */
+[[nodiscard]] std::string format_field(std::string_view spec, const Argument& argument) {
+    return std::visit([&](const auto& value) {
+        try {
+            return std::vformat(std::format("{{:{}}}", spec), std::make_format_args(value));
+        } catch (const std::format_error&) {
+            return std::format("{}", value);
+        }
+    }, argument);
+}
+
+[[nodiscard]] std::string format_std(std::string_view fmt, const std::vector<Argument>& args) {
+    std::string result;
+    std::size_t next = 0;
+    for (std::size_t i = 0; i < fmt.size(); ++i) {
+        const char c = fmt[i];
+        if ((c == '{' || c == '}') && i + 1 < fmt.size() && fmt[i + 1] == c) {
+            result += c;
+            ++i;
+            continue;
+        }
+        if (c != '{') {
+            result += c;
+            continue;
+        }
+
+        const auto end = fmt.find('}', i);
+        if (end == std::string_view::npos) break;
+        const auto field = fmt.substr(i + 1, end - i - 1);
+        const auto colon = field.find(':');
+        const auto index_text = field.substr(0, colon);
+        const auto spec = colon == std::string_view::npos ? ""sv : field.substr(colon + 1);
+
+        std::size_t index = next++;
+        if (!index_text.empty()) {
+            index = 0;
+            for (const char digit : index_text) index = index * 10 + static_cast<std::size_t>(digit - '0');
+        }
+        result += index < args.size() ? format_field(spec, args[index]) : "{?}"s;
+        i = end;
+    }
+    return result;
+}
+
+template <typename T>
+[[nodiscard]] std::string snprintf_string(const std::string& spec, T value) {
+    const int size = std::snprintf(nullptr, 0, spec.c_str(), value);
+    if (size < 0) return spec;
+    std::string result(static_cast<std::size_t>(size), '\0');
+    std::snprintf(result.data(), result.size() + 1, spec.c_str(), value);
+    return result;
+}
+
+/* mirrors logger_walk_args() in patch.c: '*' widths were logged as arguments, integers were
+ * widened to 64 bits and are re-formatted with an ll length modifier */
+[[nodiscard]] std::string format_printf(std::string_view fmt, const std::vector<Argument>& args) {
+    std::string result;
+    std::size_t next = 0;
+    const auto take = [&]() -> const Argument& {
+        static const Argument missing{std::string("?")};
+        return next < args.size() ? args[next++] : missing;
+    };
+
+    for (std::size_t i = 0; i < fmt.size(); ++i) {
+        if (fmt[i] != '%') {
+            result += fmt[i];
+            continue;
+        }
+        if (++i < fmt.size() && fmt[i] == '%') {
+            result += '%';
+            continue;
+        }
+
+        std::string spec = "%";
+        while (i < fmt.size() && "-+ #0"sv.contains(fmt[i])) spec += fmt[i++];
+        for (int part = 0; part < 2; ++part) {
+            if (i < fmt.size() && fmt[i] == '*') {
+                spec += std::to_string(argument_as<std::int64_t>(take()));
+                ++i;
+            }
+            while (i < fmt.size() && fmt[i] >= '0' && fmt[i] <= '9') spec += fmt[i++];
+            if (part == 0 && i < fmt.size() && fmt[i] == '.') spec += fmt[i++];
+            else break;
+        }
+        while (i < fmt.size() && "hlzjtL"sv.contains(fmt[i])) ++i;
+        if (i >= fmt.size()) break;
+
+        const char conversion = fmt[i];
+        switch (conversion) {
+            case 'd': case 'i':
+                result += snprintf_string(spec + "lld", static_cast<long long>(argument_as<std::int64_t>(take())));
+                break;
+            case 'c':
+                result += snprintf_string(spec + "c", static_cast<int>(argument_as<std::int64_t>(take())));
+                break;
+            case 'u': case 'o': case 'x': case 'X':
+                result += snprintf_string(spec + "ll" + conversion,
+                                          static_cast<unsigned long long>(argument_as<std::uint64_t>(take())));
+                break;
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                result += snprintf_string(spec + conversion, argument_as<double>(take()));
+                break;
+            case 's':
+                result += snprintf_string(spec + "s", argument_as<std::string>(take()).c_str());
+                break;
+            case 'p':
+                result += snprintf_string(spec + "p",
+                                          reinterpret_cast<void*>(static_cast<std::uintptr_t>(argument_as<std::uint64_t>(take()))));
+                break;
+            default:
+                break;
+        }
+    }
+    return result;
+}
+
+// decoder
+
+class LogDecoder {
+public:
+    static constexpr std::string_view magic{"PPLOG\x01\0\0", 8};
+
+    explicit LogDecoder(std::string data) : data_(std::move(data)) {}
+
+    [[nodiscard]] std::expected<void, std::string> decode(std::ostream& out) {
+        // text written before the log was switched to binary passes through unchanged
+        pos_ = data_.find(magic);
+        out << std::string_view(data_).substr(0, pos_);
+        if (pos_ == std::string::npos) return {};
+
+        while (pos_ < data_.size()) {
+            if (std::string_view(data_).substr(pos_).starts_with(magic)) {
+                pos_ += magic.size();
+                wall_anchor_ = read<std::int64_t>();
+                mono_anchor_ = read<std::int64_t>();
+                sites_.clear();
+                continue;
+            }
+
+            const auto offset = pos_;
+            switch (read<char>()) {
+                case 'S': read_site(); break;
+                case 'R': read_record(out); break;
+                case '[': {
+                    // a text line, appended by a text logger to a log shared with binary sessions
+                    const auto end = data_.find('\n', offset);
+                    pos_ = end == std::string::npos ? data_.size() : end + 1;
+                    out << std::string_view(data_).substr(offset, pos_ - offset);
+                    break;
+                }
+                default:
+                    return std::unexpected(std::format("corrupt record at offset {}", offset));
+            }
+            if (truncated_) {
+                std::println(stderr, "warning: log ends in a partial record at offset {}", offset);
+                break;
+            }
+        }
+        return {};
+    }
+
+private:
+    template <typename T>
+    [[nodiscard]] T read() {
+        T value{};
+        if (pos_ + sizeof(T) > data_.size()) {
+            truncated_ = true;
+            pos_ = data_.size();
+            return value;
+        }
+        std::memcpy(&value, data_.data() + pos_, sizeof(T));
+        pos_ += sizeof(T);
+        return value;
+    }
+
+    template <typename Length>
+    [[nodiscard]] std::string read_string() {
+        const auto size = read<Length>();
+        if (pos_ + size > data_.size()) {
+            truncated_ = true;
+            pos_ = data_.size();
+            return {};
+        }
+        std::string value = data_.substr(pos_, size);
+        pos_ += size;
+        return value;
+    }
+
+    void read_site() {
+        const auto id = read<std::uint32_t>();
+        Site site;
+        site.style = read<std::uint8_t>();
+        site.line = read<std::uint32_t>();
+        site.format = read_string<std::uint16_t>();
+        site.file = read_string<std::uint16_t>();
+        site.function = read_string<std::uint16_t>();
+        sites_.insert_or_assign(id, std::move(site));
+    }
+
+    void read_record(std::ostream& out) {
+        const auto id = read<std::uint32_t>();
+        const auto level = read<std::uint8_t>();
+        const auto timestamp = read<std::int64_t>();
+        std::vector<Argument> args(read<std::uint8_t>());
+        for (auto& arg : args) {
+            switch (read<char>()) {
+                case 'i': arg = read<std::int64_t>(); break;
+                case 'u': arg = read<std::uint64_t>(); break;
+                case 'd': arg = read<double>(); break;
+                case 'b': arg = read<std::uint8_t>() != 0; break;
+                case 's': arg = read_string<std::uint32_t>(); break;
+                default: truncated_ = true; break;
+            }
+        }
+        if (truncated_) return;
+
+        const auto it = sites_.find(id);
+        if (it == sites_.end()) {
+            std::println(out, "[unknown site {}]", id);
+            return;
+        }
+        const auto& site = it->second;
+        const auto when = system_clock::time_point(
+            duration_cast<system_clock::duration>(nanoseconds(wall_anchor_ + (timestamp - mono_anchor_))));
+
+        if (site.style == 0) {
+            std::print(out, "[{:%Y-%m-%d %H:%M:%S}] {}: {} [{}:{}:{}]\n",
+                       zoned_time{current_zone(), when}, level_to_string(level),
+                       format_std(site.format, args), site.file, site.function, site.line);
+        } else {
+            std::print(out, "[{:%Y-%m-%d %H:%M:%S}] {}: {}\n",
+                       zoned_time{current_zone(), floor<seconds>(when)}, level_to_string(level),
+                       format_printf(site.format, args));
+        }
+    }
+
+    static constexpr std::string_view level_to_string(std::uint8_t level) noexcept {
+        switch (level) {
+            case 0: return "DEBUG"sv;
+            case 1: return "INFO"sv;
+            case 2: return "WARNING"sv;
+            case 3: return "ERROR"sv;
+            default: return "UNKNOWN"sv;
+        }
+    }
+
+    std::string data_;
+    std::size_t pos_{0};
+    bool truncated_{false};
+    std::int64_t wall_anchor_{0};
+    std::int64_t mono_anchor_{0};
+    std::unordered_map<std::uint32_t, Site> sites_;
+};
+
+int main(int argc, char* argv[]) {
+    const std::span args(argv, static_cast<std::size_t>(argc));
+    if (args.size() == 2 && (args[1] == "-h"sv || args[1] == "--help"sv)) {
+        std::println(stderr, "Usage: {} [log-file...]   (default: every /var/log/port_patcher-*.plog)", args[0]);
+        return EXIT_FAILURE;
+    }
+
+    // session files are named after their start time, so name order is chronological
+    std::vector<fs::path> log_paths(args.begin() + 1, args.end());
+    if (log_paths.empty()) {
+        std::error_code ec;
+        for (const auto& item : fs::directory_iterator("/var/log", ec)) {
+            const auto name = item.path().filename().string();
+            if (name.starts_with("port_patcher-") && item.path().extension() == ".plog") log_paths.push_back(item.path());
+        }
+        std::ranges::sort(log_paths);
+    }
+
+    for (const auto& log_path : log_paths) {
+        std::ifstream in(log_path, std::ios::binary);
+        if (!in) {
+            std::println(stderr, "Error: cannot open {}", log_path.string());
+            return EXIT_FAILURE;
+        }
+
+        LogDecoder decoder(std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>{}));
+        if (auto result = decoder.decode(std::cout); !result) {
+            std::println(stderr, "Error: {}: {}", log_path.string(), result.error());
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -1,31 +1,66 @@
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cerrno>
 #include <chrono>
+#include <coroutine>
+#include <cstdint>
 #include <cstdio>
+#include <cstring>
+#include <deque>
+#include <exception>
 #include <expected>
 #include <filesystem>
 #include <format>
 #include <fstream>
 #include <functional>
+#include <future>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <print>
 #include <ranges>
 #include <source_location>
 #include <span>
+#include <sstream>
 #include <string>
 #include <string_view>
 #include <system_error>
 #include <thread>
+#include <tuple>
+#include <type_traits>
 #include <unordered_map>
 #include <utility>
+#include <variant>
 #include <vector>
 
-#ifdef __linux__
+#ifdef __unix__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #endif
 
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#elif defined(__unix__)
+#include <sys/event.h>
+#endif
+
+#if __has_include(<zstd.h>)
+#include <zstd.h>
+#define PATCHER_HAVE_ZSTD 1
+#endif
+
 namespace fs = std::filesystem;
 using namespace std::chrono;
 using namespace std::string_literals;
@@ -33,15 +68,27 @@ using namespace std::string_view_literals;
 
 // logger
 
+/* binary log layout, shared with port_logdecode.cpp and logger_log() in patch.c:
+ *   session: "PPLOG\x01\0\0", i64 system clock ns, i64 monotonic ns (anchor for the records below)
+ *   site:    'S', u32 id, u8 style (0 std::format, 1 printf), u32 line, u16-prefixed format, file, function
+ *   record:  'R', u32 site id, u8 level, i64 monotonic ns, u8 argc, then per argument a tag
+ *            ('i' i64, 'u' u64, 'd' f64, 'b' u8, 's' u32-prefixed bytes) and its payload
+ * all fields host-endian */
 class Logger{
 public:
 	enum class Level : uint8_t { DEBUG, INFO, WARNING, ERROR };
+	enum class Format : uint8_t { TEXT, BINARY };
 	
-	constexpr Logger(std::ostream& out = std::cout, Level min_level = Level::INFO) noexcept :out_(out), min_level_(min_level) {}
+	constexpr Logger(std::ostream& out = std::cout, Level min_level = Level::INFO, Format format = Format::TEXT) noexcept
+		:out_(out), min_level_(min_level), format_(format) {}
 	template <typename... Args>
 	void log(Level level, std::format_string<Args...> fmt, Args&&... args,
 			const std::source_location& loc = std::source_location::current()){
 		if (level < min_level_) return;
+		if (format_ == Format::BINARY) {
+			log_binary(level, fmt.get(), loc, args...);
+			return;
+		}
 		std::scoped_lock lock(mutex_);
 		auto now = zoned_time{current_zone(), system_clock::now()};
 		std::print(out_, "[{:%Y-%m-%d %H:%M:%S}] {}: {} [{}:{}:{}]\n",
@@ -81,9 +128,90 @@ public:
 		void set_min_level(Level level) noexcept { min_level_ = level; }
 		[[nodiscard]] Level get_min_level() const noexcept { return min_level_;}
 
+		static constexpr std::string_view binary_magic{"PPLOG\x01\0\0", 8};
+
 private:
+	/* formatting is deferred to port_logdecode: only the site id, a raw timestamp and the
+	 * arguments are written, the format string and location go out once per site */
+	template <typename... Args>
+	void log_binary(Level level, std::string_view fmt, const std::source_location& loc, const Args&... args) {
+		const auto now = duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+		thread_local std::string arguments;
+		arguments.clear();
+		(encode_argument(arguments, args), ...);
+
+		std::scoped_lock lock(mutex_);
+		auto& out = out_.get();
+		if (!anchored_) {
+			const auto wall = duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count();
+			out.write(binary_magic.data(), binary_magic.size());
+			write_raw(out, static_cast<std::int64_t>(wall));
+			write_raw(out, static_cast<std::int64_t>(now));
+			anchored_ = true;
+		}
+
+		auto [site, inserted] = sites_.try_emplace(
+			std::tuple{fmt.data(), loc.file_name(), loc.line()}, static_cast<std::uint32_t>(sites_.size()));
+		if (inserted) {
+			out.put('S');
+			write_raw(out, site->second);
+			write_raw(out, std::uint8_t{0});
+			write_raw(out, static_cast<std::uint32_t>(loc.line()));
+			for (std::string_view text : {fmt, std::string_view(loc.file_name()), std::string_view(loc.function_name())}) {
+				write_raw(out, static_cast<std::uint16_t>(text.size()));
+				out.write(text.data(), static_cast<std::streamsize>(text.size()));
+			}
+		}
+
+		out.put('R');
+		write_raw(out, site->second);
+		write_raw(out, static_cast<std::uint8_t>(level));
+		write_raw(out, static_cast<std::int64_t>(now));
+		write_raw(out, static_cast<std::uint8_t>(sizeof...(Args)));
+		out.write(arguments.data(), static_cast<std::streamsize>(arguments.size()));
+	}
+
+	template <typename T>
+	static void write_raw(std::ostream& out, T value) {
+		out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+	}
+
+	template <typename T>
+	static void append_raw(std::string& buffer, T value) {
+		buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+	}
+
+	template <typename T>
+	static void encode_argument(std::string& buffer, const T& value) {
+		using U = std::remove_cvref_t<T>;
+		if constexpr (std::is_same_v<U, bool>) {
+			buffer.push_back('b');
+			append_raw(buffer, static_cast<std::uint8_t>(value));
+		} else if constexpr (std::is_integral_v<U> && std::is_signed_v<U>) {
+			buffer.push_back('i');
+			append_raw(buffer, static_cast<std::int64_t>(value));
+		} else if constexpr (std::is_integral_v<U>) {
+			buffer.push_back('u');
+			append_raw(buffer, static_cast<std::uint64_t>(value));
+		} else if constexpr (std::is_floating_point_v<U>) {
+			buffer.push_back('d');
+			append_raw(buffer, static_cast<double>(value));
+		} else if constexpr (std::is_convertible_v<const U&, std::string_view>) {
+			const std::string_view text = value;
+			buffer.push_back('s');
+			append_raw(buffer, static_cast<std::uint32_t>(text.size()));
+			buffer.append(text);
+		} else {
+			// anything else is formatted eagerly; it only loses its format spec
+			encode_argument(buffer, std::format("{}", value));
+		}
+	}
+
 	std::reference_wrapper<std::ostream> out_;
 	Level min_level_;
+	Format format_;
+	bool anchored_{false};
+	std::map<std::tuple<const char*, const char*, std::uint_least32_t>, std::uint32_t> sites_;
 	std::mutex mutex_;
 };
 
@@ -140,270 +268,3367 @@ public:
 		}
 		return output;
 	}
+
+	/* what EventLoop::execute() reports: exit status plus wall time and peak RSS from wait4() */
+	struct Measured {
+		int status;
+		std::string output;
+		duration<double> elapsed;
+		std::size_t max_rss_kb;
+	};
 	
 };
 
-class PortPatcher {
+// coroutines
+
+template <typename T>
+struct TaskResult {
+    std::optional<T> value;
+    void return_value(T result) { value.emplace(std::move(result)); }
+    T take() { return std::move(*value); }
+};
+
+template <>
+struct TaskResult<void> {
+    void return_void() noexcept {}
+    void take() noexcept {}
+};
+
+/* lazily started coroutine; co_await runs it to completion, start() runs it eagerly so it
+ * overlaps with whatever the caller does before awaiting it */
+template <typename T = void>
+class [[nodiscard]] Task {
 public:
-	struct Config {
-		std::string port_name;
-		fs::path patch_file;
-		fs::path backup_dir;
-		fs::path ports_dir{"/usr/ports"};
-		bool dry_run{false};
-		bool force{false};
-	};
-	
-	PortPatcher(Config config, Logger& logger):config_(std::move(config)),logger_(logger){}
-	
-	[[nodiscard]] std::expected<void, std::string> run(){
-		try{
-			logger_.info("starting  port patching for {}", config_.port_name);
-			verify_prerequisites();
-			create_backup_dir();
-			
-			auto wrksrc = backup_original();
-			apply_patch(wrksrc);
-			
-			if (!config_.dry_run) {
-				rebuild_port();
-			}
-			
-			logger_.info("successfully patched {}", config_.port_name);
-			return {};
-			
-		} catch (const std::exception& e){
-			return std::unexpected(std::format("Operation failed: {}", e.what()));
-			}
-		}
-	}
-private:
+    struct promise_type : TaskResult<T> {
+        std::coroutine_handle<> continuation{std::noop_coroutine()};
+        std::exception_ptr error;
 
-	void verify_prerequisites() const {
-		const auto port_dir = config_.ports_dir / "x11" / config_.port_name;
-		if(!fs::exists(port_dir)){
-			throw std::runtime_error(std::format("Port directory not found {}:, port_dir.string()));
-			}
-		if (!fs::exists(config_.patch_file)){
-			throw std::runtime_error(std::format("patch file not found: {}", config_.patch_file.string()));
-			}
-		logger_.debug("prerequisistes verified succeessfuly");
-	}
-	void create_backup_dir() const {
-		std::error_code ec;
-		fs::create_directories(config_.backup_dir, ec);
-		
-		if(ec){
-			throw std::runtime_error(std::format("failed to create backup directory: {}", ec.message()));
-			}
-		logger_.debug("Backup directory ready: {}", config_.backup_dir.string());
-	}
-	std::string backup_original(){
-		logger_.info("Backing up original source files...");
-		const auto port_dir= config_.ports_dir / "x11" / config_.port_name;
-		
-		// execute make extract
-		auto result = CommandExecutor::execute(
-			std::format("cd {} && make extract", port_dir.string()), logger_);
-		
-		if (!result || result->status != 0 ) {
-			throw std::runtime_error("make extract failed");
-		}
-		
-		// get wrksrc directory
-		auto wrksrc = CommandExecutor::execute_with_output(
-			std::format("cd {} && make -v WRKSRC", port_dir.string()), logger_);
-		
-		if (!wrksrc){
-			throw std::runtime_error(std::format("failed to get WRKSRC: {}", wrksrc.error()));
-			}
-		
-		fs::path source_dir = port_dir / *wrksrc;
-		fs::path backup_path = config_.backup_dir / 
-			std::format("{}-original-{}", config_.port_name, get_timestamp());
-		
-		// copy directory  using modern filesystem operations
-		std::error_code ec;
-		fs::copy(source_dir, backup_path, fs::copy_options::recursive | fs::copy_options::copy_symlinks, ec);
-		
-		if (ec){
-			throw std::runtime_error(std::format("backup failed: {}", ec.message()));
-		}
-		
-		logger_.info("backup created at: {}", backup_path.string());
-		return *wrksrc;
-		}
-		void apply_patch(const std::string& wrksrc){
-			logger_.info("applying patch {}", config_.patch_file.string());
-			const auto port_dir = config_.ports_dir / "x11" / config_.port_name;
-			const auto source_dir = port_dir / wrksrc;
-			const auto patch_cmd = std::format("cd {} && patch -p1 < {}", source_dir.strin(), config_.patch_file.string());
-		
-		if (config_.dry_run){
-			logger_.info("[DRY RUN] would execute: {}", patch_cmd);
-			return;
-		}
-		
-		auto result = CommandExecutor::execute(patch_cmd, logger_);
-		if (!result || result->status != 0) { 
-			logger_.error("patch failed! attempting restore...");
-			restore_from_backup(source_dir);
-			throw std::runtime_error("patch application failed");
-			}
-		}
-		void restore_from_backup(const fs::path& target_dir) {
-        // Find backups using modern ranges
-        auto backups = fs::directory_iterator(config_.backup_dir)
-            | std::views::filter([this](const auto& entry) {
-                return entry.path().string().contains(config_.port_name + "-original-");
-            })
-            | std::ranges::to<std::vector>();
-        
-        if (backups.empty()) {
-            throw std::runtime_error("No backup found to restore from");
-        }
-        
-        // Sort by modification time
-        std::ranges::sort(backups, [](const auto& a, const auto& b) {
-            return fs::last_write_time(a) > fs::last_write_time(b);
-        });
-        
-        const auto& latest_backup = backups.front();
-        logger_.info("Restoring from backup: {}", latest_backup.string());
-        
-        // Clear target directory using modern filesystem operations
-        std::error_code ec;
-        for (const auto& entry : fs::directory_iterator(target_dir)) {
-            fs::remove_all(entry.path(), ec);
-            if (ec) {
-                logger_.warning("Failed to remove {}: {}", entry.path().string(), ec.message());
-            }
+        Task get_return_object() noexcept { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        auto final_suspend() noexcept {
+            struct ResumeAwaiting {
+                bool await_ready() noexcept { return false; }
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> self) noexcept {
+                    return self.promise().continuation;
+                }
+                void await_resume() noexcept {}
+            };
+            return ResumeAwaiting{};
         }
-        
-        // Copy with modern recursive iterator
-        for (const auto& entry : fs::recursive_directory_iterator(latest_backup)) {
-            const auto relative = fs::relative(entry.path(), latest_backup);
-            const auto dest = target_dir / relative;
-            
-            if (fs::is_directory(entry.status())) {
-                fs::create_directories(dest, ec);
-            } else {
-                fs::copy_file(entry.path(), dest, fs::copy_options::overwrite_existing, ec);
-            }
-            
-            if (ec) {
-                throw std::runtime_error(std::format("Restore failed during copy: {}", ec.message()));
-            }
+        void unhandled_exception() noexcept { error = std::current_exception(); }
+    };
+
+    Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, {})), started_(other.started_) {}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (handle_) handle_.destroy();
+            handle_ = std::exchange(other.handle_, {});
+            started_ = other.started_;
         }
+        return *this;
+    }
+    ~Task() {
+        if (handle_) handle_.destroy();
     }
 
-    void rebuild_port() {
-        logger_.info("Rebuilding port with patch...");
-        
-        const auto port_dir = config_.ports_dir / "x11" / config_.port_name;
-        const auto rebuild_cmd = std::format("cd {} && make clean install", port_dir.string());
-        
-        auto result = CommandExecutor::execute(rebuild_cmd, logger_);
-        if (!result || result->status != 0) {
-            throw std::runtime_error("make clean install failed");
-        }
+    void start() {
+        if (!std::exchange(started_, true)) handle_.resume();
     }
 
-    [[nodiscard]] static std::string get_timestamp() {
-        auto now = zoned_time{current_zone(), system_clock::now()};
-        return std::format("{:%Y%m%d-%H%M%S}", now);
+    [[nodiscard]] bool done() const noexcept { return handle_.done(); }
+
+    bool await_ready() const noexcept { return handle_.done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle_.promise().continuation = awaiting;
+        if (std::exchange(started_, true)) return std::noop_coroutine();
+        return handle_;
     }
+    T await_resume() { return result(); }
 
-    Config config_;
-    Logger& logger_;
-};
+    T result() {
+        if (handle_.promise().error) std::rethrow_exception(handle_.promise().error);
+        return handle_.promise().take();
+    }
 
-struct CLIArgs {
-    std::string port_name;
-    fs::path patch_file;
-    fs::path backup_dir{"/usr/local/etc/patches"};
-    bool dry_run{false};
-    bool verbose{false};
-    bool help{false};
+private:
+    explicit Task(std::coroutine_handle<promise_type> handle) noexcept : handle_(handle) {}
+
+    std::coroutine_handle<promise_type> handle_;
+    bool started_{false};
 };
 
-[[nodiscard]] std::expected<CLIArgs, std::string> parse_args(std::span<const char*> args) {
-    CLIArgs cli_args;
-    
-    for (size_t i = 1; i < args.size(); ++i) {
-        std::string_view arg = args[i];
-        
-        if (arg == "--help" || arg == "-h") {
-            cli_args.help = true;
-        } else if (arg == "--dry-run" || arg == "-n") {
-            cli_args.dry_run = true;
-        } else if (arg == "--verbose" || arg == "-v") {
-            cli_args.verbose = true;
-        } else if (arg == "--backup-dir" || arg == "-b") {
-            if (++i >= args.size()) return std::unexpected("Missing backup directory");
-            cli_args.backup_dir = args[i];
-        } else if (!arg.starts_with('-')) {
-            if (cli_args.port_name.empty()) {
-                cli_args.port_name = arg;
-            } else if (cli_args.patch_file.empty()) {
-                cli_args.patch_file = arg;
-            }
-        } else {
-            return std::unexpected(std::format("Unknown argument: {}", arg));
-        }
+template <typename T>
+using TaskValue = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+template <typename T>
+Task<TaskValue<T>> as_value(Task<T> task) {
+    if constexpr (std::is_void_v<T>) {
+        co_await task;
+        co_return std::monostate{};
+    } else {
+        co_return co_await task;
     }
-    
-    if (cli_args.help) return cli_args;
-    if (cli_args.port_name.empty()) return std::unexpected("Port name required");
-    if (cli_args.patch_file.empty()) return std::unexpected("Patch file required");
-    
-    return cli_args;
 }
 
-void print_usage(std::string_view program_name) {
-    std::print("Usage: {} <port-name> <patch-file> [options]\n", program_name);
-    std::print("Options:\n");
-    std::print("  -h, --help           Show this help message\n");
-    std::print("  -n, --dry-run        Don't actually apply changes\n");
-    std::print("  -v, --verbose        Enable verbose output\n");
-    std::print("  -b, --backup-dir DIR Specify backup directory\n");
-}
+/* runs both tasks concurrently; both are always finished before the first error is rethrown */
+template <typename A, typename B>
+Task<std::pair<TaskValue<A>, TaskValue<B>>> when_all(Task<A> a, Task<B> b) {
+    auto first = as_value(std::move(a));
+    auto second = as_value(std::move(b));
+    first.start();
+    second.start();
 
-int main(int argc, char* argv[]) {
+    std::exception_ptr error;
+    std::optional<TaskValue<A>> first_value;
+    std::optional<TaskValue<B>> second_value;
     try {
-        // Parse command line arguments
-        auto args = parse_args({argv, static_cast<size_t>(argc)});
-        if (!args) {
-            std::println(stderr, "Error: {}", args.error());
-            print_usage(argv[0]);
-            return EXIT_FAILURE;
+        first_value.emplace(co_await first);
+    } catch (...) {
+        error = std::current_exception();
+    }
+    try {
+        second_value.emplace(co_await second);
+    } catch (...) {
+        if (!error) error = std::current_exception();
+    }
+    if (error) std::rethrow_exception(error);
+    co_return std::pair{std::move(*first_value), std::move(*second_value)};
+}
+
+// event loop
+
+/* single-threaded reactor the port phases run on: pipe reads and child exits come from
+ * epoll + pidfd on Linux and kqueue on the BSDs, blocking filesystem work runs on a thread
+ * and resumes its coroutine back on the loop */
+class EventLoop {
+public:
+    EventLoop() {
+        #if defined(__linux__)
+        poll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        wake_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.ptr = nullptr;
+        if (poll_fd_ < 0 || wake_fd_ < 0 || epoll_ctl(poll_fd_, EPOLL_CTL_ADD, wake_fd_, &event) != 0) {
+            throw std::runtime_error(std::format("failed to create event loop: {}", std::strerror(errno)));
         }
-        
-        if (args->help) {
-            print_usage(argv[0]);
-            return EXIT_SUCCESS;
+        #elif defined(__unix__)
+        poll_fd_ = kqueue();
+        struct kevent event;
+        EV_SET(&event, 0, EVFILT_USER, EV_ADD | EV_CLEAR, 0, 0, nullptr);
+        if (poll_fd_ < 0 || kevent(poll_fd_, &event, 1, nullptr, 0, nullptr) != 0) {
+            throw std::runtime_error(std::format("failed to create event loop: {}", std::strerror(errno)));
         }
-        
-        // Initialize logging
-        std::ofstream log_file("/var/log/port_patcher.log", std::ios::app);
-        Logger file_logger(log_file, args->verbose ? Logger::Level::DEBUG : Logger::Level::INFO);
-        Logger console_logger(std::cout, args->verbose ? Logger::Level::DEBUG : Logger::Level::INFO);
-        
-        // Create and run patcher
-        PortPatcher::Config config{
-            .port_name = args->port_name,
-            .patch_file = args->patch_file,
-            .backup_dir = args->backup_dir,
-            .dry_run = args->dry_run
+        #else
+        throw std::runtime_error("event loop unsupported on this platform");
+        #endif
+    }
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    ~EventLoop() {
+        workers_.clear();
+        #ifdef __unix__
+        if (wake_fd_ >= 0) close(wake_fd_);
+        if (poll_fd_ >= 0) close(poll_fd_);
+        #endif
+    }
+
+    template <typename T>
+    T run_until_complete(Task<T> task) {
+        task.start();
+        while (!task.done()) {
+            poll_once();
+        }
+        return task.result();
+    }
+
+    /* wakes every coroutine waiting on it; used for "budget freed up" style conditions */
+    class Signal {
+    public:
+        explicit Signal(EventLoop& loop) : loop_(loop) {}
+
+        [[nodiscard]] auto wait() {
+            struct Awaiter {
+                Signal& signal;
+                bool await_ready() const noexcept { return false; }
+                void await_suspend(std::coroutine_handle<> awaiting) { signal.waiters_.push_back(awaiting); }
+                void await_resume() const noexcept {}
+            };
+            return Awaiter{*this};
+        }
+
+        void notify_all() {
+            for (auto waiter : std::exchange(waiters_, {})) {
+                loop_.post(waiter);
+            }
+        }
+
+    private:
+        EventLoop& loop_;
+        std::vector<std::coroutine_handle<>> waiters_;
+    };
+
+    [[nodiscard]] auto readable(int fd) {
+        struct Awaiter {
+            EventLoop& loop;
+            int fd;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> awaiting) { loop.watch(fd, awaiting); }
+            void await_resume() { loop.unwatch(fd); }
         };
-        
-        PortPatcher patcher(config, file_logger);
+        return Awaiter{*this, fd};
+    }
+
+    /* completes once the child has exited; the caller still reaps it */
+    [[nodiscard]] Task<void> process_exit(pid_t pid) {
+        #if defined(__linux__)
+        #ifdef SYS_pidfd_open
+        const int pidfd = static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+        #else
+        const int pidfd = -1;
+        #endif
+        if (pidfd >= 0) {
+            co_await readable(pidfd);
+            close(pidfd);
+            co_return;
+        }
+        // kernels before 5.3 have no pidfd: wait on a worker without reaping
+        co_await offload([pid] {
+            siginfo_t info;
+            while (waitid(P_PID, static_cast<id_t>(pid), &info, WEXITED | WNOWAIT) < 0 && errno == EINTR) {}
+        });
+        #elif defined(__unix__)
+        struct Awaiter {
+            EventLoop& loop;
+            pid_t pid;
+            bool await_ready() const noexcept { return false; }
+            bool await_suspend(std::coroutine_handle<> awaiting) {
+                struct kevent event;
+                EV_SET(&event, pid, EVFILT_PROC, EV_ADD | EV_ONESHOT, NOTE_EXIT, 0, awaiting.address());
+                // fails with ESRCH when the child is already a zombie: nothing to wait for
+                return kevent(loop.poll_fd_, &event, 1, nullptr, 0, nullptr) == 0;
+            }
+            void await_resume() const noexcept {}
+        };
+        co_await Awaiter{*this, pid};
+        #else
+        (void)pid;
+        co_return;
+        #endif
+    }
+
+    /* runs fn on a worker thread; the awaiting coroutine resumes on the loop */
+    template <typename Fn>
+    Task<std::invoke_result_t<Fn&>> offload(Fn fn) {
+        using R = std::invoke_result_t<Fn&>;
+        std::exception_ptr error;
+        if constexpr (std::is_void_v<R>) {
+            co_await OnWorker{*this, [&] { fn(); }, error};
+            if (error) std::rethrow_exception(error);
+        } else {
+            std::optional<R> result;
+            co_await OnWorker{*this, [&] { result.emplace(fn()); }, error};
+            if (error) std::rethrow_exception(error);
+            co_return std::move(*result);
+        }
+    }
+
+    /* CommandExecutor::execute() without blocking the loop; the child is reaped with wait4() so
+     * the caller also gets wall time and peak RSS */
+    [[nodiscard]] Task<CommandExecutor::Measured> execute(std::string command, Logger& logger) {
+        logger.debug("Executing (async): {}", command);
+
+        #ifdef __unix__
+        std::string shell = "/bin/sh";
+        std::string flag = "-c";
+        std::array<char*, 4> argv{shell.data(), flag.data(), command.data(), nullptr};
+
+        // close-on-exec, so concurrently spawned children do not hold each other's pipes open
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) != 0) {
+            throw std::runtime_error("pipe() failed");
+        }
+
+        const auto start = steady_clock::now();
+        const pid_t pid = fork();
+        if (pid < 0) {
+            close(fds[0]);
+            close(fds[1]);
+            throw std::runtime_error("fork() failed");
+        }
+        if (pid == 0) {
+            dup2(fds[1], STDOUT_FILENO);
+            execv(argv[0], argv.data());
+            _exit(127);
+        }
+        close(fds[1]);
+        fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+
+        std::string output;
+        std::array<char, 4096> buffer;
+        for (;;) {
+            const ssize_t n = read(fds[0], buffer.data(), buffer.size());
+            if (n > 0) {
+                output.append(buffer.data(), static_cast<std::size_t>(n));
+            } else if (n == 0) {
+                break;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                co_await readable(fds[0]);
+            } else if (errno != EINTR) {
+                break;
+            }
+        }
+        close(fds[0]);
+
+        co_await process_exit(pid);
+        int status = 0;
+        struct rusage usage{};
+        while (wait4(pid, &status, 0, &usage) < 0 && errno == EINTR) {}
+
+        if (!output.empty()) {
+            logger.debug("command output:\n{}", output);
+        }
+        co_return CommandExecutor::Measured{status, std::move(output), steady_clock::now() - start,
+                                            static_cast<std::size_t>(usage.ru_maxrss)};
+        #else
+        throw std::runtime_error("Unsupported platform");
+        #endif
+    }
+
+private:
+    struct OnWorker {
+        EventLoop& loop;
+        std::function<void()> work;
+        std::exception_ptr& error;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> awaiting) {
+            std::jthread worker([this, awaiting, &loop = loop] {
+                try {
+                    work();
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                {
+                    std::scoped_lock lock(loop.mutex_);
+                    loop.finished_.push_back(std::this_thread::get_id());
+                }
+                loop.post(awaiting);
+            });
+            const auto id = worker.get_id();
+            loop.workers_.emplace(id, std::move(worker));
+        }
+        void await_resume() const noexcept {}
+    };
+
+    void post(std::coroutine_handle<> handle) {
+        {
+            std::scoped_lock lock(mutex_);
+            posted_.push_back(handle);
+        }
+        #if defined(__linux__)
+        const std::uint64_t one = 1;
+        [[maybe_unused]] auto written = write(wake_fd_, &one, sizeof(one));
+        #elif defined(__unix__)
+        struct kevent event;
+        EV_SET(&event, 0, EVFILT_USER, 0, NOTE_TRIGGER, 0, nullptr);
+        kevent(poll_fd_, &event, 1, nullptr, 0, nullptr);
+        #endif
+    }
+
+    void watch([[maybe_unused]] int fd, [[maybe_unused]] std::coroutine_handle<> awaiting) {
+        #if defined(__linux__)
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLONESHOT;
+        event.data.ptr = awaiting.address();
+        if (epoll_ctl(poll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+            throw std::runtime_error(std::format("epoll_ctl failed: {}", std::strerror(errno)));
+        }
+        #elif defined(__unix__)
+        struct kevent event;
+        EV_SET(&event, fd, EVFILT_READ, EV_ADD | EV_ONESHOT, 0, 0, awaiting.address());
+        if (kevent(poll_fd_, &event, 1, nullptr, 0, nullptr) != 0) {
+            throw std::runtime_error(std::format("kevent failed: {}", std::strerror(errno)));
+        }
+        #endif
+    }
+
+    void unwatch([[maybe_unused]] int fd) {
+        #if defined(__linux__)
+        epoll_ctl(poll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+        #endif
+    }
+
+    void poll_once() {
+        std::vector<std::coroutine_handle<>> ready;
+        #if defined(__linux__)
+        std::array<epoll_event, 64> events;
+        const int count = epoll_wait(poll_fd_, events.data(), static_cast<int>(events.size()), -1);
+        if (count < 0 && errno != EINTR) {
+            throw std::runtime_error(std::format("epoll_wait failed: {}", std::strerror(errno)));
+        }
+        for (int i = 0; i < count; ++i) {
+            if (events[i].data.ptr == nullptr) {
+                std::uint64_t drained;
+                [[maybe_unused]] auto got = read(wake_fd_, &drained, sizeof(drained));
+            } else {
+                ready.push_back(std::coroutine_handle<>::from_address(events[i].data.ptr));
+            }
+        }
+        #elif defined(__unix__)
+        std::array<struct kevent, 64> events;
+        const int count = kevent(poll_fd_, nullptr, 0, events.data(), static_cast<int>(events.size()), nullptr);
+        if (count < 0 && errno != EINTR) {
+            throw std::runtime_error(std::format("kevent failed: {}", std::strerror(errno)));
+        }
+        for (int i = 0; i < count; ++i) {
+            if (events[i].filter != EVFILT_USER) {
+                ready.push_back(std::coroutine_handle<>::from_address(reinterpret_cast<void*>(events[i].udata)));
+            }
+        }
+        #endif
+        std::vector<std::thread::id> finished;
+        {
+            std::scoped_lock lock(mutex_);
+            ready.insert(ready.end(), posted_.begin(), posted_.end());
+            posted_.clear();
+            finished.swap(finished_);
+        }
+        // join workers as they finish, so a long batch does not keep every stack mapped; offloaded
+        // work may block on the jobserver, which rules out a fixed-size pool
+        for (const auto id : finished) {
+            workers_.erase(id);
+        }
+        for (auto handle : ready) {
+            handle.resume();
+        }
+    }
+
+    int poll_fd_{-1};
+    int wake_fd_{-1};
+    std::mutex mutex_;
+    std::vector<std::coroutine_handle<>> posted_;
+    std::vector<std::thread::id> finished_;
+    std::unordered_map<std::thread::id, std::jthread> workers_;
+};
+
+// hashing
+
+/* streaming XXH64; used to fingerprint phase inputs and installed files */
+class XXH64 {
+public:
+    explicit XXH64(std::uint64_t seed = 0) noexcept
+        : acc_{seed + P1 + P2, seed + P2, seed, seed - P1}, seed_(seed) {}
+
+    void update(std::span<const std::byte> data) noexcept {
+        total_ += data.size();
+        if (buffered_ != 0) {
+            const auto n = std::min(buffer_.size() - buffered_, data.size());
+            std::memcpy(buffer_.data() + buffered_, data.data(), n);
+            buffered_ += n;
+            data = data.subspan(n);
+            if (buffered_ < buffer_.size()) return;
+            consume(buffer_.data());
+            buffered_ = 0;
+        }
+        while (data.size() >= stripe) {
+            consume(data.data());
+            data = data.subspan(stripe);
+        }
+        std::memcpy(buffer_.data(), data.data(), data.size());
+        buffered_ = data.size();
+    }
+
+    void update(std::string_view text) noexcept { update(std::as_bytes(std::span(text))); }
+
+    [[nodiscard]] std::uint64_t digest() const noexcept {
+        std::uint64_t h;
+        if (total_ >= stripe) {
+            h = std::rotl(acc_[0], 1) + std::rotl(acc_[1], 7) + std::rotl(acc_[2], 12) + std::rotl(acc_[3], 18);
+            for (auto acc : acc_) {
+                h ^= round(0, acc);
+                h = h * P1 + P4;
+            }
+        } else {
+            h = seed_ + P5;
+        }
+        h += total_;
+
+        const std::byte* p = buffer_.data();
+        auto remaining = buffered_;
+        for (; remaining >= 8; p += 8, remaining -= 8) {
+            h ^= round(0, load<std::uint64_t>(p));
+            h = std::rotl(h, 27) * P1 + P4;
+        }
+        if (remaining >= 4) {
+            h ^= std::uint64_t{load<std::uint32_t>(p)} * P1;
+            h = std::rotl(h, 23) * P2 + P3;
+            p += 4;
+            remaining -= 4;
+        }
+        for (; remaining > 0; ++p, --remaining) {
+            h ^= std::to_integer<std::uint64_t>(*p) * P5;
+            h = std::rotl(h, 11) * P1;
+        }
+
+        h ^= h >> 33;
+        h *= P2;
+        h ^= h >> 29;
+        h *= P3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    [[nodiscard]] static std::uint64_t hash(std::span<const std::byte> data, std::uint64_t seed = 0) noexcept {
+        XXH64 hasher(seed);
+        hasher.update(data);
+        return hasher.digest();
+    }
+
+private:
+    static constexpr std::uint64_t P1 = 0x9E3779B185EBCA87ULL;
+    static constexpr std::uint64_t P2 = 0xC2B2AE3D27D4EB4FULL;
+    static constexpr std::uint64_t P3 = 0x165667B19E3779F9ULL;
+    static constexpr std::uint64_t P4 = 0x85EBCA77C2B2AE63ULL;
+    static constexpr std::uint64_t P5 = 0x27D4EB2F165667C5ULL;
+    static constexpr std::size_t stripe = 32;
+
+    template <typename T>
+    [[nodiscard]] static T load(const std::byte* p) noexcept {
+        T value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    [[nodiscard]] static constexpr std::uint64_t round(std::uint64_t acc, std::uint64_t input) noexcept {
+        acc += input * P2;
+        return std::rotl(acc, 31) * P1;
+    }
+
+    /* four independent lanes in scalar registers; the multiply chains overlap instead of waiting on each other */
+    void consume(const std::byte* p) noexcept {
+        for (std::size_t lane = 0; lane < acc_.size(); ++lane) {
+            acc_[lane] = round(acc_[lane], load<std::uint64_t>(p + lane * 8));
+        }
+    }
+
+    std::array<std::uint64_t, 4> acc_;
+    std::array<std::byte, stripe> buffer_{};
+    std::size_t buffered_{0};
+    std::uint64_t total_{0};
+    std::uint64_t seed_;
+};
+
+/* feeds a file's contents, followed by their length so consecutive files cannot run together;
+ * for keys that must not depend on where the file lives */
+inline void hash_contents_into(XXH64& hasher, const fs::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    std::uint64_t length = 0;
+    std::array<char, 65536> buffer;
+    while (in && (in.read(buffer.data(), buffer.size()) || in.gcount() > 0)) {
+        hasher.update(std::as_bytes(std::span(buffer.data(), static_cast<std::size_t>(in.gcount()))));
+        length += static_cast<std::uint64_t>(in.gcount());
+    }
+    hasher.update(std::as_bytes(std::span(&length, 1)));
+}
+
+/* feeds a file into the hasher salted with its path; a missing file hashes as its path alone so
+ * it still changes the digest */
+inline void hash_file_into(XXH64& hasher, const fs::path& path) {
+    hasher.update(path.string());
+    hash_contents_into(hasher, path);
+}
+
+// checkpoints
+
+/* per-port record of completed phases, each stamped with a hash of the inputs it was run against */
+class PhaseCheckpoints {
+public:
+    enum class Phase : std::size_t { EXTRACTED, BACKED_UP, PATCHED, BUILT, INSTALLED };
+    static constexpr std::size_t phase_count = 5;
+    using Inputs = std::array<std::uint64_t, phase_count>;
+
+    explicit PhaseCheckpoints(fs::path file) : file_(std::move(file)) {
+        std::ifstream in(file_);
+        std::string line;
+        // one record per line; the detail is the rest of the line and may be empty
+        while (std::getline(in, line)) {
+            std::istringstream record(line);
+            std::string name;
+            std::uint64_t hash;
+            if (!(record >> name >> std::hex >> hash)) continue;
+            std::string detail;
+            std::getline(record >> std::ws, detail);
+            for (std::size_t i = 0; i < phase_count; ++i) {
+                if (name == phase_to_string(static_cast<Phase>(i))) {
+                    entries_[i] = Entry{hash, std::move(detail)};
+                }
+            }
+        }
+    }
+
+    [[nodiscard]] bool valid(Phase phase, const Inputs& inputs) const noexcept {
+        const auto& entry = entries_[std::to_underlying(phase)];
+        return entry && entry->hash == inputs[std::to_underlying(phase)];
+    }
+
+    [[nodiscard]] std::string detail(Phase phase) const {
+        const auto& entry = entries_[std::to_underlying(phase)];
+        return entry ? entry->detail : std::string{};
+    }
+
+    /* records a completed phase and forgets everything after it */
+    void mark(Phase phase, const Inputs& inputs, std::string detail = {}) {
+        const auto index = std::to_underlying(phase);
+        entries_[index] = Entry{inputs[index], std::move(detail)};
+        std::ranges::fill(entries_ | std::views::drop(index + 1), std::nullopt);
+        save();
+    }
+
+    void clear() {
+        std::ranges::fill(entries_, std::nullopt);
+        std::error_code ec;
+        fs::remove(file_, ec);
+    }
+
+    static constexpr std::string_view phase_to_string(Phase phase) noexcept {
+        using enum Phase;
+        switch (phase) {
+            case EXTRACTED: return "extracted"sv;
+            case BACKED_UP: return "backed-up"sv;
+            case PATCHED: return "patched"sv;
+            case BUILT: return "built"sv;
+            case INSTALLED: return "installed"sv;
+            default: return "unknown"sv;
+        }
+    }
+
+private:
+    struct Entry {
+        std::uint64_t hash;
+        std::string detail;
+    };
+
+    void save() const {
+        // write-and-rename so an interrupted run never leaves a half-written checkpoint file
+        const auto tmp = fs::path(file_) += ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::trunc);
+            for (std::size_t i = 0; i < phase_count; ++i) {
+                if (!entries_[i]) break;
+                std::println(out, "{} {:016x} {}", phase_to_string(static_cast<Phase>(i)),
+                             entries_[i]->hash, entries_[i]->detail);
+            }
+            if (!out) throw std::runtime_error(std::format("failed to write checkpoint {}", tmp.string()));
+        }
+        fs::rename(tmp, file_);
+    }
+
+    fs::path file_;
+    std::array<std::optional<Entry>, phase_count> entries_;
+};
+
+// binary io
+
+/* host-endian fields and length-prefixed strings shared by the on-disk formats below */
+namespace binio {
+
+template <typename T>
+void put(std::ostream& out, T value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename Length = std::uint16_t>
+void put_string(std::ostream& out, std::string_view value) {
+    put(out, static_cast<Length>(value.size()));
+    out.write(value.data(), static_cast<std::streamsize>(value.size()));
+}
+
+template <typename T>
+[[nodiscard]] T get(std::istream& in) {
+    T value{};
+    in.read(reinterpret_cast<char*>(&value), sizeof(value));
+    return value;
+}
+
+template <typename Length = std::uint16_t>
+[[nodiscard]] std::string get_string(std::istream& in) {
+    std::string value(get<Length>(in), '\0');
+    in.read(value.data(), static_cast<std::streamsize>(value.size()));
+    return value;
+}
+
+} // namespace binio
+
+// backup archive
+
+/* seekable backup archive: file data concatenated into fixed-size blocks, each block an
+ * independent zstd frame, followed by an index of blocks and entries so any file can be
+ * restored by decompressing only the blocks that cover it */
+class BackupArchive {
+public:
+    enum class EntryType : std::uint8_t { DIRECTORY, FILE, SYMLINK };
+
+    struct Entry {
+        EntryType type;
+        std::uint32_t mode;
+        std::uint64_t offset; // into the uncompressed data stream
+        std::uint64_t size;
+        std::string path;     // relative to the archived tree
+        std::string target;   // symlinks only
+    };
+
+    struct Stats {
+        std::size_t files{0};
+        std::uint64_t raw_bytes{0};
+        std::uint64_t stored_bytes{0};
+        duration<double> elapsed{};
+    };
+
+    static constexpr std::size_t block_size = 1 << 20;
+    static constexpr std::string_view extension = ".ppar"sv;
+
+    explicit BackupArchive(fs::path archive) : archive_(std::move(archive)) {
+        std::ifstream in(archive_, std::ios::binary);
+        if (!in) throw std::runtime_error(std::format("cannot open archive {}", archive_.string()));
+
+        std::array<char, magic.size()> header;
+        in.read(header.data(), header.size());
+        codec_ = binio::get<std::uint8_t>(in);
+        if (!in || std::string_view(header.data(), header.size()) != magic) {
+            throw std::runtime_error(std::format("{} is not a backup archive", archive_.string()));
+        }
+        #ifndef PATCHER_HAVE_ZSTD
+        if (codec_ == codec_zstd) {
+            throw std::runtime_error("archive is zstd compressed but zstd support was not built in");
+        }
+        #endif
+
+        in.seekg(-static_cast<std::streamoff>(sizeof(std::uint64_t) + magic.size()), std::ios::end);
+        const auto index_offset = binio::get<std::uint64_t>(in);
+        in.read(header.data(), header.size());
+        if (!in || std::string_view(header.data(), header.size()) != magic) {
+            throw std::runtime_error(std::format("{} has no index (truncated backup?)", archive_.string()));
+        }
+
+        in.seekg(static_cast<std::streamoff>(index_offset));
+        blocks_.resize(binio::get<std::uint64_t>(in));
+        for (auto& block : blocks_) {
+            block.offset = binio::get<std::uint64_t>(in);
+            block.stored_size = binio::get<std::uint32_t>(in);
+            block.raw_size = binio::get<std::uint32_t>(in);
+        }
+        entries_.resize(binio::get<std::uint64_t>(in));
+        for (auto& entry : entries_) {
+            entry.type = static_cast<EntryType>(binio::get<std::uint8_t>(in));
+            entry.mode = binio::get<std::uint32_t>(in);
+            entry.offset = binio::get<std::uint64_t>(in);
+            entry.size = binio::get<std::uint64_t>(in);
+            entry.path = binio::get_string(in);
+            entry.target = binio::get_string(in);
+        }
+        if (!in) throw std::runtime_error(std::format("corrupt index in {}", archive_.string()));
+    }
+
+    /* streams source_dir into archive; up to `threads` blocks are compressed concurrently. The
+     * archive is written next to its final name and renamed into place once complete */
+    [[nodiscard]] static Stats create(const fs::path& source_dir, const fs::path& archive,
+                                      unsigned threads, int level = 3) {
+        const auto start = steady_clock::now();
+        threads = std::max(threads, 1u);
+
+        const auto tmp = fs::path(archive) += ".tmp";
+        struct Discard {
+            const fs::path& path;
+            bool keep{false};
+            ~Discard() {
+                std::error_code ec;
+                if (!keep) fs::remove(path, ec);
+            }
+        } discard{tmp};
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out) throw std::runtime_error(std::format("cannot create archive {}", archive.string()));
+        #ifdef PATCHER_HAVE_ZSTD
+        const std::uint8_t codec = codec_zstd;
+        #else
+        const std::uint8_t codec = codec_raw;
+        #endif
+        out.write(magic.data(), magic.size());
+        binio::put(out, codec);
+
+        Stats stats;
+        std::vector<Block> blocks;
+        std::vector<Entry> entries;
+        std::deque<std::future<std::vector<std::byte>>> in_flight;
+        std::vector<std::uint32_t> in_flight_sizes;
+        std::uint64_t offset = magic.size() + sizeof(codec);
+        std::vector<std::byte> block;
+        block.reserve(block_size);
+
+        // frames are written in submission order, so the archive stays a plain stream
+        const auto drain = [&](std::size_t keep) {
+            while (in_flight.size() > keep) {
+                const auto frame = in_flight.front().get();
+                in_flight.pop_front();
+                blocks.push_back({offset, static_cast<std::uint32_t>(frame.size()), in_flight_sizes.front()});
+                in_flight_sizes.erase(in_flight_sizes.begin());
+                out.write(reinterpret_cast<const char*>(frame.data()), static_cast<std::streamsize>(frame.size()));
+                offset += frame.size();
+            }
+        };
+        const auto flush = [&] {
+            if (block.empty()) return;
+            in_flight_sizes.push_back(static_cast<std::uint32_t>(block.size()));
+            in_flight.push_back(std::async(std::launch::async, compress, std::move(block), codec, level));
+            block = {};
+            block.reserve(block_size);
+            drain(threads);
+        };
+
+        for (const auto& item : fs::recursive_directory_iterator(source_dir)) {
+            const auto status = item.symlink_status();
+            Entry entry{
+                .type = EntryType::FILE,
+                .mode = static_cast<std::uint32_t>(status.permissions()),
+                .offset = stats.raw_bytes,
+                .size = 0,
+                .path = item.path().lexically_relative(source_dir).generic_string(),
+                .target = {},
+            };
+
+            if (fs::is_symlink(status)) {
+                entry.type = EntryType::SYMLINK;
+                entry.target = fs::read_symlink(item.path()).string();
+            } else if (fs::is_directory(status)) {
+                entry.type = EntryType::DIRECTORY;
+            } else if (fs::is_regular_file(status)) {
+                std::ifstream in(item.path(), std::ios::binary);
+                if (!in) throw std::runtime_error(std::format("cannot read {}", item.path().string()));
+                for (;;) {
+                    const auto used = block.size();
+                    block.resize(block_size);
+                    in.read(reinterpret_cast<char*>(block.data() + used), static_cast<std::streamsize>(block_size - used));
+                    const auto got = static_cast<std::size_t>(in.gcount());
+                    block.resize(used + got);
+                    entry.size += got;
+                    if (block.size() == block_size) flush();
+                    if (!in) break;
+                }
+                ++stats.files;
+                stats.raw_bytes += entry.size;
+            } else {
+                continue; // sockets, fifos and devices have no place in a source tree
+            }
+            entries.push_back(std::move(entry));
+        }
+        flush();
+        drain(0);
+
+        const auto index_offset = offset;
+        binio::put<std::uint64_t>(out, blocks.size());
+        for (const auto& b : blocks) {
+            binio::put(out, b.offset);
+            binio::put(out, b.stored_size);
+            binio::put(out, b.raw_size);
+        }
+        binio::put<std::uint64_t>(out, entries.size());
+        for (const auto& entry : entries) {
+            binio::put(out, static_cast<std::uint8_t>(entry.type));
+            binio::put(out, entry.mode);
+            binio::put(out, entry.offset);
+            binio::put(out, entry.size);
+            binio::put_string(out, entry.path);
+            binio::put_string(out, entry.target);
+        }
+        binio::put<std::uint64_t>(out, index_offset);
+        out.write(magic.data(), magic.size());
+        out.close();
+        if (!out) throw std::runtime_error(std::format("failed to write archive {}", archive.string()));
+        fs::rename(tmp, archive);
+        discard.keep = true;
+
+        stats.stored_bytes = fs::file_size(archive);
+        stats.elapsed = steady_clock::now() - start;
+        return stats;
+    }
+
+    [[nodiscard]] const std::vector<Entry>& entries() const noexcept { return entries_; }
+
+    /* restores the whole tree; blocks are decompressed and written out by `threads` workers */
+    void extract_all(const fs::path& target_dir, unsigned threads) const {
+        std::vector<const Entry*> files;
+        for (const auto& entry : entries_) {
+            const auto dest = target_dir / entry.path;
+            switch (entry.type) {
+                case EntryType::DIRECTORY:
+                    fs::create_directories(dest);
+                    break;
+                case EntryType::SYMLINK:
+                    fs::create_directories(dest.parent_path());
+                    fs::create_symlink(entry.target, dest);
+                    break;
+                case EntryType::FILE:
+                    fs::create_directories(dest.parent_path());
+                    std::ofstream(dest, std::ios::binary | std::ios::trunc);
+                    if (entry.size > 0) files.push_back(&entry);
+                    break;
+            }
+        }
+
+        std::atomic<std::size_t> next_block{0};
+        std::exception_ptr failure;
+        std::mutex failure_mutex;
+        {
+            std::vector<std::jthread> workers;
+            for (unsigned i = 0; i < std::max(threads, 1u); ++i) {
+                workers.emplace_back([&] {
+                    try {
+                        std::ifstream in(archive_, std::ios::binary);
+                        for (auto index = next_block++; index < blocks_.size(); index = next_block++) {
+                            write_block(in, index, files, target_dir);
+                        }
+                    } catch (...) {
+                        std::scoped_lock lock(failure_mutex);
+                        if (!failure) failure = std::current_exception();
+                    }
+                });
+            }
+        }
+        if (failure) std::rethrow_exception(failure);
+
+        for (const auto& entry : entries_) {
+            if (entry.type != EntryType::SYMLINK) {
+                fs::permissions(target_dir / entry.path, static_cast<fs::perms>(entry.mode));
+            }
+        }
+    }
+
+    /* restores a single file, touching only the blocks that hold it */
+    void extract_file(const fs::path& relative, const fs::path& dest) const {
+        const auto it = std::ranges::find(entries_, relative.generic_string(), &Entry::path);
+        if (it == entries_.end() || it->type != EntryType::FILE) {
+            throw std::runtime_error(std::format("{} is not a file in {}", relative.string(), archive_.string()));
+        }
+
+        const std::vector<const Entry*> files{&*it};
+        std::ofstream(dest, std::ios::binary | std::ios::trunc);
+        std::ifstream in(archive_, std::ios::binary);
+        const auto first = it->offset / block_size;
+        const auto last = (it->offset + it->size + block_size - 1) / block_size;
+        for (auto index = first; index < last; ++index) {
+            write_block(in, index, files, dest.parent_path(), dest);
+        }
+        fs::permissions(dest, static_cast<fs::perms>(it->mode));
+    }
+
+private:
+    struct Block {
+        std::uint64_t offset;
+        std::uint32_t stored_size;
+        std::uint32_t raw_size;
+    };
+
+    static constexpr std::string_view magic = "PPARCH01"sv;
+    static constexpr std::uint8_t codec_raw = 0;
+    static constexpr std::uint8_t codec_zstd = 1;
+
+    [[nodiscard]] static std::vector<std::byte> compress(std::vector<std::byte> raw, std::uint8_t codec, int level) {
+        #ifdef PATCHER_HAVE_ZSTD
+        if (codec == codec_zstd) {
+            std::vector<std::byte> frame(ZSTD_compressBound(raw.size()));
+            const auto size = ZSTD_compress(frame.data(), frame.size(), raw.data(), raw.size(), level);
+            if (ZSTD_isError(size)) {
+                throw std::runtime_error(std::format("zstd compression failed: {}", ZSTD_getErrorName(size)));
+            }
+            frame.resize(size);
+            return frame;
+        }
+        #else
+        (void)codec;
+        (void)level;
+        #endif
+        return raw;
+    }
+
+    [[nodiscard]] std::vector<std::byte> read_block(std::ifstream& in, std::size_t index) const {
+        const auto& block = blocks_[index];
+        std::vector<std::byte> stored(block.stored_size);
+        in.seekg(static_cast<std::streamoff>(block.offset));
+        in.read(reinterpret_cast<char*>(stored.data()), static_cast<std::streamsize>(stored.size()));
+        if (!in) throw std::runtime_error(std::format("short read of block {} in {}", index, archive_.string()));
+
+        #ifdef PATCHER_HAVE_ZSTD
+        if (codec_ == codec_zstd) {
+            std::vector<std::byte> raw(block.raw_size);
+            const auto size = ZSTD_decompress(raw.data(), raw.size(), stored.data(), stored.size());
+            if (ZSTD_isError(size) || size != raw.size()) {
+                throw std::runtime_error(std::format("block {} of {} is corrupt", index, archive_.string()));
+            }
+            return raw;
+        }
+        #endif
+        return stored;
+    }
+
+    /* writes the parts of block `index` that belong to `files` (sorted by offset); a non-empty
+     * `dest` overrides the destination path of a single file */
+    void write_block(std::ifstream& in, std::size_t index, const std::vector<const Entry*>& files,
+                     const fs::path& target_dir, const fs::path& dest = {}) const {
+        const auto raw = read_block(in, index);
+        const std::uint64_t begin = index * block_size;
+        const std::uint64_t end = begin + raw.size();
+
+        auto it = std::ranges::partition_point(files, [&](const Entry* entry) {
+            return entry->offset + entry->size <= begin;
+        });
+        for (; it != files.end() && (*it)->offset < end; ++it) {
+            const auto& entry = **it;
+            const auto from = std::max(entry.offset, begin);
+            const auto to = std::min(entry.offset + entry.size, end);
+
+            std::fstream out(dest.empty() ? target_dir / entry.path : dest,
+                             std::ios::binary | std::ios::in | std::ios::out);
+            out.seekp(static_cast<std::streamoff>(from - entry.offset));
+            out.write(reinterpret_cast<const char*>(raw.data() + (from - begin)),
+                      static_cast<std::streamsize>(to - from));
+            if (!out) throw std::runtime_error(std::format("failed to restore {}", entry.path));
+        }
+    }
+
+    fs::path archive_;
+    std::uint8_t codec_{codec_raw};
+    std::vector<Block> blocks_;
+    std::vector<Entry> entries_;
+};
+
+// patch series
+
+/* an ordered list of unified diffs folded into one bundle: for every touched file the hash of
+ * the upstream content it expects and a copy/insert delta that yields the fully patched file */
+class PatchBundle {
+public:
+    struct Op {
+        enum class Kind : std::uint8_t { COPY, INSERT } kind;
+        std::uint64_t offset{0}; // COPY: byte range of the upstream file
+        std::uint64_t length{0};
+        std::string data;        // INSERT
+    };
+
+    struct FileDelta {
+        std::string path;
+        bool upstream_absent{false};
+        bool result_absent{false};
+        std::uint64_t upstream_hash{0};
+        std::vector<Op> ops;
+    };
+
+    static constexpr std::string_view extension = ".ppb"sv;
+
+    /* a series file lists one patch per line, relative to the series file; '#' starts a comment */
+    [[nodiscard]] static std::vector<fs::path> read_series(const fs::path& series_file) {
+        std::ifstream in(series_file);
+        if (!in) throw std::runtime_error(std::format("cannot read series {}", series_file.string()));
+
+        std::vector<fs::path> series;
+        std::string line;
+        while (std::getline(in, line)) {
+            line = line.substr(0, line.find('#'));
+            const auto first = line.find_first_not_of(" \t\r");
+            if (first == std::string::npos) continue;
+            const auto last = line.find_last_not_of(" \t\r");
+            series.push_back(series_file.parent_path() / line.substr(first, last - first + 1));
+        }
+        return series;
+    }
+
+    /* content only, so the cache key is the same wherever the series is checked out */
+    [[nodiscard]] static std::uint64_t series_hash(std::span<const fs::path> series) {
+        XXH64 hasher;
+        for (const auto& patch : series) {
+            hash_contents_into(hasher, patch);
+        }
+        return hasher.digest();
+    }
+
+    /* parses every patch without looking at the tree, so it can run before the sources exist;
+     * returns the number of file patches */
+    static std::size_t validate(std::span<const fs::path> series, int strip = 1) {
+        std::size_t file_patches = 0;
+        for (const auto& patch : series) {
+            const auto text = read_file(patch);
+            if (!text) throw std::runtime_error(std::format("cannot read patch {}", patch.string()));
+            const auto parsed = parse(*text, strip);
+            if (parsed.empty()) throw std::runtime_error(std::format("{} contains no file patches", patch.string()));
+            file_patches += parsed.size();
+        }
+        return file_patches;
+    }
+
+    /* applies the series in memory against the pristine tree in source_dir */
+    [[nodiscard]] static PatchBundle compile(std::span<const fs::path> series, const fs::path& source_dir,
+                                             std::string version, int strip = 1) {
+        PatchBundle bundle;
+        bundle.version_ = std::move(version);
+        bundle.series_hash_ = series_hash(series);
+
+        std::map<std::string, Working> files;
+        for (const auto& patch : series) {
+            const auto text = read_file(patch);
+            if (!text) throw std::runtime_error(std::format("cannot read patch {}", patch.string()));
+
+            for (auto& file_patch : parse(*text, strip)) {
+                const bool creates = file_patch.old_path == "/dev/null";
+                const bool deletes = file_patch.new_path == "/dev/null";
+                const auto& target = deletes ? file_patch.old_path : file_patch.new_path;
+
+                auto [it, inserted] = files.try_emplace(target);
+                auto& working = it->second;
+                if (inserted) working.load(source_dir / target);
+                working.drift = 0;
+                if (creates && !working.lines.empty()) {
+                    throw std::runtime_error(std::format("{}: creates {} which already exists", patch.string(), target));
+                }
+
+                for (const auto& hunk : file_patch.hunks) {
+                    if (!working.apply(hunk)) {
+                        throw std::runtime_error(std::format("{}: hunk @@ -{} @@ does not apply to {}",
+                                                             patch.string(), hunk.old_start, target));
+                    }
+                }
+                working.result_absent = deletes;
+                if (deletes) working.lines.clear();
+            }
+        }
+
+        for (auto& [path, working] : files) {
+            bundle.files_.push_back(working.delta(path));
+        }
+        return bundle;
+    }
+
+    [[nodiscard]] static PatchBundle load(const fs::path& file) {
+        std::ifstream in(file, std::ios::binary);
+        std::array<char, magic.size()> header;
+        in.read(header.data(), header.size());
+        if (!in || std::string_view(header.data(), header.size()) != magic) {
+            throw std::runtime_error(std::format("{} is not a patch bundle", file.string()));
+        }
+
+        PatchBundle bundle;
+        bundle.series_hash_ = binio::get<std::uint64_t>(in);
+        bundle.version_ = binio::get_string(in);
+        bundle.files_.resize(binio::get<std::uint32_t>(in));
+        for (auto& delta : bundle.files_) {
+            delta.path = binio::get_string(in);
+            const auto flags = binio::get<std::uint8_t>(in);
+            delta.upstream_absent = flags & 1;
+            delta.result_absent = flags & 2;
+            delta.upstream_hash = binio::get<std::uint64_t>(in);
+            delta.ops.resize(binio::get<std::uint32_t>(in));
+            for (auto& op : delta.ops) {
+                op.kind = static_cast<Op::Kind>(binio::get<std::uint8_t>(in));
+                if (op.kind == Op::Kind::COPY) {
+                    op.offset = binio::get<std::uint64_t>(in);
+                    op.length = binio::get<std::uint64_t>(in);
+                } else {
+                    op.data = binio::get_string<std::uint32_t>(in);
+                    op.length = op.data.size();
+                }
+            }
+        }
+        if (!in) throw std::runtime_error(std::format("truncated patch bundle {}", file.string()));
+        return bundle;
+    }
+
+    void save(const fs::path& file) const {
+        const auto tmp = fs::path(file) += ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+            out.write(magic.data(), magic.size());
+            binio::put(out, series_hash_);
+            binio::put_string(out, version_);
+            binio::put(out, static_cast<std::uint32_t>(files_.size()));
+            for (const auto& delta : files_) {
+                binio::put_string(out, delta.path);
+                binio::put(out, static_cast<std::uint8_t>((delta.upstream_absent ? 1 : 0) | (delta.result_absent ? 2 : 0)));
+                binio::put(out, delta.upstream_hash);
+                binio::put(out, static_cast<std::uint32_t>(delta.ops.size()));
+                for (const auto& op : delta.ops) {
+                    binio::put(out, static_cast<std::uint8_t>(op.kind));
+                    if (op.kind == Op::Kind::COPY) {
+                        binio::put(out, op.offset);
+                        binio::put(out, op.length);
+                    } else {
+                        binio::put_string<std::uint32_t>(out, op.data);
+                    }
+                }
+            }
+            if (!out) throw std::runtime_error(std::format("failed to write patch bundle {}", tmp.string()));
+        }
+        fs::rename(tmp, file);
+    }
+
+    /* checks every touched file against its expected upstream hash before writing any of them;
+     * returns false (tree untouched) when the tree is not the one the bundle was compiled for */
+    [[nodiscard]] bool apply(const fs::path& source_dir) const {
+        std::vector<std::string> upstream(files_.size());
+        for (std::size_t i = 0; i < files_.size(); ++i) {
+            const auto& delta = files_[i];
+            auto content = read_file(source_dir / delta.path);
+            if (delta.upstream_absent) {
+                if (content) return false;
+                continue;
+            }
+            if (!content || XXH64::hash(std::as_bytes(std::span(*content))) != delta.upstream_hash) return false;
+            upstream[i] = std::move(*content);
+        }
+
+        for (std::size_t i = 0; i < files_.size(); ++i) {
+            const auto& delta = files_[i];
+            const auto target = source_dir / delta.path;
+            if (delta.result_absent) {
+                fs::remove(target);
+                continue;
+            }
+
+            std::string result;
+            for (const auto& op : delta.ops) {
+                if (op.kind == Op::Kind::COPY) {
+                    result.append(upstream[i], op.offset, op.length);
+                } else {
+                    result += op.data;
+                }
+            }
+
+            const auto tmp = fs::path(target) += ".ppb-tmp";
+            fs::create_directories(target.parent_path());
+            {
+                std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+                out.write(result.data(), static_cast<std::streamsize>(result.size()));
+                if (!out) throw std::runtime_error(std::format("failed to write {}", tmp.string()));
+            }
+            if (!delta.upstream_absent) {
+                fs::permissions(tmp, fs::status(target).permissions());
+            }
+            fs::rename(tmp, target);
+        }
+        return true;
+    }
+
+    [[nodiscard]] const std::vector<FileDelta>& files() const noexcept { return files_; }
+    [[nodiscard]] const std::string& version() const noexcept { return version_; }
+
+private:
+    struct Hunk {
+        std::size_t old_start{0};
+        std::size_t old_count{0};
+        std::vector<std::pair<char, std::string>> lines; // ' ', '-' or '+' and the line with its newline
+    };
+
+    struct FilePatch {
+        std::string old_path;
+        std::string new_path;
+        std::vector<Hunk> hunks;
+    };
+
+    struct Line {
+        std::string text;
+        std::int64_t origin; // upstream line index, -1 for inserted lines
+    };
+
+    /* one file while the series is folded into it */
+    struct Working {
+        bool upstream_absent{false};
+        bool result_absent{false};
+        std::string upstream;
+        std::vector<std::uint64_t> offsets; // byte offset of every upstream line
+        std::vector<Line> lines;
+        std::int64_t drift{0};              // net lines added by earlier hunks of the current patch
+
+        void load(const fs::path& path) {
+            auto content = read_file(path);
+            upstream_absent = !content;
+            upstream = content.value_or(std::string{});
+            for (std::size_t pos = 0; pos < upstream.size();) {
+                const auto end = std::min(upstream.find('\n', pos), upstream.size() - 1) + 1;
+                offsets.push_back(pos);
+                lines.push_back({upstream.substr(pos, end - pos), static_cast<std::int64_t>(lines.size())});
+                pos = end;
+            }
+        }
+
+        /* exact-context match at the expected line, searching outwards like patch(1) without fuzz */
+        [[nodiscard]] bool apply(const Hunk& hunk) {
+            std::vector<const std::string*> old_side;
+            for (const auto& [kind, text] : hunk.lines) {
+                if (kind != '+') old_side.push_back(&text);
+            }
+
+            const auto matches_at = [&](std::size_t at) {
+                if (at + old_side.size() > lines.size()) return false;
+                for (std::size_t i = 0; i < old_side.size(); ++i) {
+                    if (lines[at + i].text != *old_side[i]) return false;
+                }
+                return true;
+            };
+
+            const auto base = static_cast<std::int64_t>(hunk.old_count == 0 ? hunk.old_start : hunk.old_start - 1);
+            const auto expected = static_cast<std::size_t>(std::clamp<std::int64_t>(
+                base + drift, 0, static_cast<std::int64_t>(lines.size())));
+            std::optional<std::size_t> at;
+            for (std::size_t distance = 0; !at && distance <= lines.size(); ++distance) {
+                if (matches_at(expected + distance)) {
+                    at = expected + distance;
+                } else if (distance <= expected && matches_at(expected - distance)) {
+                    at = expected - distance;
+                }
+            }
+            if (!at) return false;
+
+            std::vector<Line> replacement;
+            std::size_t consumed = 0;
+            for (const auto& [kind, text] : hunk.lines) {
+                if (kind == '+') {
+                    replacement.push_back({text, -1});
+                } else {
+                    if (kind == ' ') replacement.push_back(std::move(lines[*at + consumed]));
+                    ++consumed;
+                }
+            }
+            const auto first = lines.begin() + static_cast<std::ptrdiff_t>(*at);
+            lines.erase(first, first + static_cast<std::ptrdiff_t>(consumed));
+            lines.insert(lines.begin() + static_cast<std::ptrdiff_t>(*at), replacement.begin(), replacement.end());
+            drift = static_cast<std::int64_t>(*at) - base
+                  + static_cast<std::int64_t>(replacement.size()) - static_cast<std::int64_t>(consumed);
+            return true;
+        }
+
+        /* runs of consecutive upstream lines become one COPY, runs of new lines one INSERT */
+        [[nodiscard]] FileDelta delta(const std::string& path) const {
+            FileDelta result{
+                .path = path,
+                .upstream_absent = upstream_absent,
+                .result_absent = result_absent,
+                .upstream_hash = upstream_absent ? 0 : XXH64::hash(std::as_bytes(std::span(upstream))),
+                .ops = {},
+            };
+            std::int64_t previous = -2;
+            for (const auto& line : lines) {
+                auto& ops = result.ops;
+                if (line.origin >= 0) {
+                    const auto offset = offsets[static_cast<std::size_t>(line.origin)];
+                    if (!ops.empty() && ops.back().kind == Op::Kind::COPY && line.origin == previous + 1) {
+                        ops.back().length += line.text.size();
+                    } else {
+                        ops.push_back({Op::Kind::COPY, offset, line.text.size(), {}});
+                    }
+                } else if (!ops.empty() && ops.back().kind == Op::Kind::INSERT) {
+                    ops.back().data += line.text;
+                    ops.back().length = ops.back().data.size();
+                } else {
+                    ops.push_back({Op::Kind::INSERT, 0, line.text.size(), line.text});
+                }
+                previous = line.origin;
+            }
+            return result;
+        }
+    };
+
+    static constexpr std::string_view magic = "PPBNDL01"sv;
+
+    [[nodiscard]] static std::optional<std::string> read_file(const fs::path& path) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) return std::nullopt;
+        return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    /* file name from a ---/+++ header: drop the timestamp, then `strip` leading components */
+    [[nodiscard]] static std::string header_path(std::string_view line, int strip) {
+        auto name = line.substr(4);
+        name = name.substr(0, name.find('\t'));
+        while (!name.empty() && (name.back() == ' ' || name.back() == '\r')) name.remove_suffix(1);
+        if (name == "/dev/null") return std::string(name);
+        for (int i = 0; i < strip; ++i) {
+            const auto slash = name.find('/');
+            if (slash == std::string_view::npos) break;
+            name.remove_prefix(slash + 1);
+        }
+        return std::string(name);
+    }
+
+    [[nodiscard]] static std::vector<FilePatch> parse(std::string_view text, int strip) {
+        std::vector<std::string_view> lines;
+        for (const auto line : text | std::views::split('\n')) {
+            lines.emplace_back(line.begin(), line.end());
+        }
+
+        std::vector<FilePatch> patches;
+        for (std::size_t i = 0; i < lines.size(); ++i) {
+            if (lines[i].starts_with("--- ") && i + 1 < lines.size() && lines[i + 1].starts_with("+++ ")) {
+                patches.push_back({header_path(lines[i], strip), header_path(lines[i + 1], strip), {}});
+                ++i;
+                continue;
+            }
+            if (!lines[i].starts_with("@@ -") || patches.empty()) continue;
+
+            Hunk hunk;
+            std::size_t new_count = 1;
+            hunk.old_count = 1;
+            std::size_t new_start = 0;
+            const auto header = std::string(lines[i]);
+            if (std::sscanf(header.c_str(), "@@ -%zu,%zu +%zu,%zu", &hunk.old_start, &hunk.old_count, &new_start, &new_count) < 3
+                && std::sscanf(header.c_str(), "@@ -%zu +%zu,%zu", &hunk.old_start, &new_start, &new_count) < 2) {
+                throw std::runtime_error(std::format("malformed hunk header: {}", header));
+            }
+
+            auto old_left = hunk.old_count;
+            auto new_left = new_count;
+            while ((old_left > 0 || new_left > 0) && ++i < lines.size()) {
+                const auto line = lines[i];
+                if (line.starts_with('\\')) {
+                    if (!hunk.lines.empty()) hunk.lines.back().second.pop_back();
+                    continue;
+                }
+                const char kind = line.empty() ? ' ' : line.front();
+                const auto body = std::string(line.empty() ? line : line.substr(1)) + '\n';
+                if (kind == ' ') {
+                    --old_left;
+                    --new_left;
+                } else if (kind == '-') {
+                    --old_left;
+                } else if (kind == '+') {
+                    --new_left;
+                } else {
+                    throw std::runtime_error(std::format("malformed hunk line: {}", line));
+                }
+                hunk.lines.emplace_back(kind, body);
+            }
+            if (i + 1 < lines.size() && lines[i + 1].starts_with('\\') && !hunk.lines.empty()) {
+                hunk.lines.back().second.pop_back();
+                ++i;
+            }
+            patches.back().hunks.push_back(std::move(hunk));
+        }
+        return patches;
+    }
+
+    std::string version_;
+    std::uint64_t series_hash_{0};
+    std::vector<FileDelta> files_;
+};
+
+// parallel for
+
+/* runs fn(0) .. fn(count - 1) on up to `threads` threads; the first exception stops the rest and is rethrown */
+template <typename Fn>
+void parallel_for(std::size_t count, unsigned threads, Fn fn) {
+    std::atomic<std::size_t> next{0};
+    std::exception_ptr failure;
+    std::mutex failure_mutex;
+    {
+        std::vector<std::jthread> workers;
+        for (unsigned t = 0; t < std::clamp<std::size_t>(threads, 1, std::max<std::size_t>(count, 1)); ++t) {
+            workers.emplace_back([&] {
+                try {
+                    for (auto i = next++; i < count; i = next++) fn(i);
+                } catch (...) {
+                    std::scoped_lock lock(failure_mutex);
+                    if (!failure) failure = std::current_exception();
+                    next = count;
+                }
+            });
+        }
+    }
+    if (failure) std::rethrow_exception(failure);
+}
+
+// install index
+
+/* content hash plus stat identity of every file a port installed, recorded right after install;
+ * verify() only re-reads files whose stat data moved. Symlinks are recorded as themselves (lstat,
+ * hash of the target path), so a dangling link is fine and a re-pointed one is drift */
+class InstallIndex {
+public:
+    struct Entry {
+        std::string path;
+        std::uint64_t size{0};
+        std::uint64_t inode{0};
+        std::int64_t mtime_ns{0};
+        std::int64_t ctime_ns{0};
+        std::uint64_t hash{0};
+    };
+
+    struct Report {
+        std::vector<std::string> drifted; // missing or changed content
+        std::size_t hashed{0};
+        std::size_t skipped{0};           // stat unchanged, not read
+    };
+
+    [[nodiscard]] static InstallIndex build(std::vector<std::string> paths, unsigned threads) {
+        InstallIndex index;
+        index.entries_.resize(paths.size());
+        parallel_for(paths.size(), threads, [&](std::size_t i) {
+            auto& entry = index.entries_[i];
+            entry.path = std::move(paths[i]);
+            if (!stat_into(entry)) {
+                throw std::runtime_error(std::format("installed file {} is missing", entry.path));
+            }
+            entry.hash = hash_entry(entry.path).value_or(0);
+        });
+        return index;
+    }
+
+    [[nodiscard]] static std::optional<InstallIndex> load(const fs::path& file) {
+        std::ifstream in(file, std::ios::binary);
+        std::array<char, magic.size()> header;
+        in.read(header.data(), header.size());
+        if (!in || std::string_view(header.data(), header.size()) != magic) return std::nullopt;
+
+        InstallIndex index;
+        index.entries_.resize(binio::get<std::uint64_t>(in));
+        for (auto& entry : index.entries_) {
+            entry.path = binio::get_string(in);
+            entry.size = binio::get<std::uint64_t>(in);
+            entry.inode = binio::get<std::uint64_t>(in);
+            entry.mtime_ns = binio::get<std::int64_t>(in);
+            entry.ctime_ns = binio::get<std::int64_t>(in);
+            entry.hash = binio::get<std::uint64_t>(in);
+        }
+        if (!in) return std::nullopt;
+        return index;
+    }
+
+    void save(const fs::path& file) const {
+        const auto tmp = fs::path(file) += ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+            out.write(magic.data(), magic.size());
+            binio::put<std::uint64_t>(out, entries_.size());
+            for (const auto& entry : entries_) {
+                binio::put_string(out, entry.path);
+                binio::put(out, entry.size);
+                binio::put(out, entry.inode);
+                binio::put(out, entry.mtime_ns);
+                binio::put(out, entry.ctime_ns);
+                binio::put(out, entry.hash);
+            }
+            if (!out) throw std::runtime_error(std::format("failed to write install index {}", tmp.string()));
+        }
+        fs::rename(tmp, file);
+    }
+
+    /* files that were touched but still hash the same get their stat data refreshed, so the
+     * next verify can skip them again */
+    [[nodiscard]] Report verify(unsigned threads) {
+        std::vector<std::uint8_t> drifted(entries_.size(), 0);
+        std::vector<std::uint8_t> hashed(entries_.size(), 0);
+        parallel_for(entries_.size(), threads, [&](std::size_t i) {
+            auto& entry = entries_[i];
+            Entry current{.path = entry.path};
+            if (!stat_into(current)) {
+                drifted[i] = 1;
+                return;
+            }
+            if (current.size == entry.size && current.inode == entry.inode &&
+                current.mtime_ns == entry.mtime_ns && current.ctime_ns == entry.ctime_ns) {
+                return;
+            }
+
+            hashed[i] = 1;
+            const auto hash = hash_entry(entry.path);
+            if (!hash || current.size != entry.size || *hash != entry.hash) {
+                drifted[i] = 1;
+                return;
+            }
+            current.hash = *hash;
+            entry = std::move(current);
+        });
+
+        Report report;
+        for (std::size_t i = 0; i < entries_.size(); ++i) {
+            if (drifted[i]) report.drifted.push_back(entries_[i].path);
+            if (hashed[i]) ++report.hashed; else if (!drifted[i]) ++report.skipped;
+        }
+        return report;
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept { return entries_.size(); }
+
+private:
+    static constexpr std::string_view magic = "PPIDX002"sv;
+
+    [[nodiscard]] static bool stat_into(Entry& entry) {
+        #ifdef __unix__
+        struct stat st;
+        if (lstat(entry.path.c_str(), &st) != 0) return false;
+        entry.size = static_cast<std::uint64_t>(st.st_size);
+        entry.inode = static_cast<std::uint64_t>(st.st_ino);
+        entry.mtime_ns = static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1'000'000'000 + st.st_mtim.tv_nsec;
+        entry.ctime_ns = static_cast<std::int64_t>(st.st_ctim.tv_sec) * 1'000'000'000 + st.st_ctim.tv_nsec;
+        return true;
+        #else
+        std::error_code ec;
+        if (fs::is_symlink(fs::symlink_status(entry.path, ec))) {
+            entry.size = fs::read_symlink(entry.path, ec).string().size();
+            return !ec;
+        }
+        entry.size = fs::file_size(entry.path, ec);
+        if (ec) return false;
+        entry.mtime_ns = fs::last_write_time(entry.path, ec).time_since_epoch().count();
+        return !ec;
+        #endif
+    }
+
+    /* links hash their target, seeded apart so a link never matches a file spelling that target */
+    [[nodiscard]] static std::optional<std::uint64_t> hash_entry(const std::string& path) {
+        std::error_code ec;
+        if (!fs::is_symlink(fs::symlink_status(path, ec))) return hash_mapped(path);
+        const auto target = fs::read_symlink(path, ec).string();
+        if (ec) return std::nullopt;
+        return XXH64::hash(std::as_bytes(std::span(target)), 1);
+    }
+
+    /* XXH64 straight off the page cache; no copy through a read buffer */
+    [[nodiscard]] static std::optional<std::uint64_t> hash_mapped(const std::string& path) {
+        #ifdef __unix__
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return std::nullopt;
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            return std::nullopt;
+        }
+        const auto size = static_cast<std::size_t>(st.st_size);
+        if (size == 0) {
+            close(fd);
+            return XXH64::hash({});
+        }
+
+        void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) return std::nullopt;
+        madvise(data, size, MADV_SEQUENTIAL);
+        const auto hash = XXH64::hash({static_cast<const std::byte*>(data), size});
+        munmap(data, size);
+        return hash;
+        #else
+        std::ifstream in(path, std::ios::binary);
+        if (!in) return std::nullopt;
+        const std::string content(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        return XXH64::hash(std::as_bytes(std::span(content)));
+        #endif
+    }
+
+    std::vector<Entry> entries_;
+};
+
+// delta packages
+
+/* the files a patched port installed, each stored as a zstd frame that uses the stock package's
+ * version of the file as prefix dictionary (the `zstd --patch-from` scheme), plus a manifest of
+ * stock and result hashes; apply() checks every stock file and decodes everything before the
+ * first installed file is replaced. Symlinks are never followed on either side; they are
+ * recorded and compared by their target */
+class DeltaPackage {
+public:
+    enum class Kind : std::uint8_t { CHANGED, ADDED, REMOVED, SYMLINK };
+
+    struct FileDelta {
+        std::string path;
+        Kind kind{Kind::CHANGED};
+        std::uint32_t mode{0};
+        std::uint64_t stock_hash{0};  // CHANGED, REMOVED; SYMLINK if replaces_stock
+        std::uint64_t result_hash{0}; // CHANGED, ADDED, SYMLINK
+        std::uint64_t result_size{0};
+        std::string payload;          // the link target for SYMLINK
+        bool replaces_stock{false};   // SYMLINK: the stock package has an entry at this path
+    };
+
+    /* a delta only fits hosts that run the same stock package and want the same patches */
+    struct Identity {
+        std::string port;
+        std::string version;
+        std::string abi;
+        std::uint64_t patch_hash{0};
+    };
+
+    static constexpr std::string_view extension = ".ppd"sv;
+
+    [[nodiscard]] static std::string file_name(const Identity& identity) {
+        auto abi = identity.abi;
+        std::ranges::replace(abi, ':', '_');
+        return std::format("{}-{}-{}-{:016x}{}", identity.port, identity.version, abi, identity.patch_hash, extension);
+    }
+
+    /* `installed` are the absolute paths of the patched port, `stock_root` the unpacked stock package */
+    [[nodiscard]] static DeltaPackage create(Identity identity, std::vector<std::string> installed,
+                                             const fs::path& stock_root, double build_seconds,
+                                             unsigned threads, int level = 19) {
+        DeltaPackage package;
+        package.identity_ = std::move(identity);
+        package.build_seconds_ = build_seconds;
+        #ifdef PATCHER_HAVE_ZSTD
+        package.codec_ = codec_zstd;
+        #endif
+
+        std::ranges::sort(installed);
+        package.files_.resize(installed.size());
+        parallel_for(installed.size(), threads, [&](std::size_t i) {
+            auto& delta = package.files_[i];
+            delta.path = std::move(installed[i]);
+            const auto result = read_entry(delta.path);
+            if (!result) throw std::runtime_error(std::format("cannot read installed file {}", delta.path));
+            delta.result_hash = entry_hash(*result);
+            delta.result_size = result->data.size();
+
+            const auto stock = read_entry(stock_root / fs::path(delta.path).relative_path());
+            if (stock) delta.stock_hash = entry_hash(*stock);
+            if (result->link) {
+                delta.kind = Kind::SYMLINK;
+                delta.replaces_stock = stock.has_value();
+                delta.payload = result->data;
+                return;
+            }
+            delta.kind = stock ? Kind::CHANGED : Kind::ADDED;
+            delta.mode = static_cast<std::uint32_t>(fs::symlink_status(delta.path).permissions());
+            delta.payload = encode(result->data, stock ? stock->data : std::string{}, package.codec_, level);
+        });
+
+        // stock files the patched build no longer installs; '+' files are package metadata
+        std::vector<FileDelta> removed;
+        for (const auto& item : fs::recursive_directory_iterator(stock_root)) {
+            if (!item.is_symlink() && !item.is_regular_file()) continue;
+            const auto relative = item.path().lexically_relative(stock_root);
+            if (relative.string().starts_with('+')) continue;
+            auto path = (fs::path("/") / relative).string();
+            if (std::ranges::binary_search(package.files_, path, {}, &FileDelta::path)) continue;
+
+            const auto stock = read_entry(item.path());
+            if (!stock) throw std::runtime_error(std::format("cannot read {}", item.path().string()));
+            auto& delta = removed.emplace_back();
+            delta.path = std::move(path);
+            delta.kind = Kind::REMOVED;
+            delta.stock_hash = entry_hash(*stock);
+        }
+        std::ranges::move(removed, std::back_inserter(package.files_));
+        return package;
+    }
+
+    [[nodiscard]] static DeltaPackage load(const fs::path& file) {
+        std::ifstream in(file, std::ios::binary);
+        std::array<char, magic.size()> header;
+        in.read(header.data(), header.size());
+        if (!in || std::string_view(header.data(), header.size()) != magic) {
+            throw std::runtime_error(std::format("{} is not a delta package", file.string()));
+        }
+
+        DeltaPackage package;
+        package.codec_ = binio::get<std::uint8_t>(in);
+        #ifndef PATCHER_HAVE_ZSTD
+        if (package.codec_ == codec_zstd) {
+            throw std::runtime_error("delta is zstd compressed but zstd support was not built in");
+        }
+        #endif
+        package.identity_.port = binio::get_string(in);
+        package.identity_.version = binio::get_string(in);
+        package.identity_.abi = binio::get_string(in);
+        package.identity_.patch_hash = binio::get<std::uint64_t>(in);
+        package.build_seconds_ = binio::get<double>(in);
+        package.files_.resize(binio::get<std::uint32_t>(in));
+        for (auto& delta : package.files_) {
+            delta.path = binio::get_string(in);
+            delta.kind = static_cast<Kind>(binio::get<std::uint8_t>(in));
+            delta.mode = binio::get<std::uint32_t>(in);
+            delta.stock_hash = binio::get<std::uint64_t>(in);
+            delta.result_hash = binio::get<std::uint64_t>(in);
+            delta.result_size = binio::get<std::uint64_t>(in);
+            delta.payload = binio::get_string<std::uint32_t>(in);
+            delta.replaces_stock = binio::get<std::uint8_t>(in) != 0;
+        }
+        if (!in) throw std::runtime_error(std::format("{} is truncated", file.string()));
+        return package;
+    }
+
+    void save(const fs::path& file) const {
+        std::ofstream out(file, std::ios::binary | std::ios::trunc);
+        out.write(magic.data(), magic.size());
+        binio::put(out, codec_);
+        binio::put_string(out, identity_.port);
+        binio::put_string(out, identity_.version);
+        binio::put_string(out, identity_.abi);
+        binio::put(out, identity_.patch_hash);
+        binio::put(out, build_seconds_);
+        binio::put(out, static_cast<std::uint32_t>(files_.size()));
+        for (const auto& delta : files_) {
+            binio::put_string(out, delta.path);
+            binio::put(out, static_cast<std::uint8_t>(delta.kind));
+            binio::put(out, delta.mode);
+            binio::put(out, delta.stock_hash);
+            binio::put(out, delta.result_hash);
+            binio::put(out, delta.result_size);
+            binio::put_string<std::uint32_t>(out, delta.payload);
+            binio::put(out, static_cast<std::uint8_t>(delta.replaces_stock));
+        }
+        if (!out) throw std::runtime_error(std::format("failed to write delta {}", file.string()));
+    }
+
+    /* installs the delta below `root`; returns false, touching nothing, when a file matches neither
+     * the stock package nor the patched result. Files already patched are left alone */
+    [[nodiscard]] bool apply(const fs::path& root, unsigned threads) const {
+        enum Outcome : std::uint8_t { STAGED, CURRENT, MISMATCH };
+        std::vector<std::uint8_t> outcomes(files_.size(), STAGED);
+        const auto target_of = [&](const FileDelta& delta) { return root / fs::path(delta.path).relative_path(); };
+        const auto staged_of = [&](const FileDelta& delta) { return fs::path(target_of(delta)) += ".ppdelta"; };
+        const auto discard = [&] {
+            std::error_code ec;
+            for (std::size_t i = 0; i < files_.size(); ++i) {
+                if (outcomes[i] == STAGED) fs::remove(staged_of(files_[i]), ec);
+            }
+        };
+
+        try {
+            parallel_for(files_.size(), threads, [&](std::size_t i) {
+                const auto& delta = files_[i];
+                const auto target = target_of(delta);
+                const auto current = read_entry(target);
+                const auto current_hash = current ? entry_hash(*current) : 0;
+
+                if (delta.kind == Kind::REMOVED) {
+                    if (current && current_hash != delta.stock_hash) outcomes[i] = MISMATCH;
+                    else if (!current) outcomes[i] = CURRENT;
+                    return;
+                }
+                if (current && current->data.size() == delta.result_size && current_hash == delta.result_hash) {
+                    outcomes[i] = CURRENT;
+                    return;
+                }
+                const bool has_stock = delta.kind == Kind::CHANGED || (delta.kind == Kind::SYMLINK && delta.replaces_stock);
+                if (has_stock && (!current || current_hash != delta.stock_hash)) {
+                    outcomes[i] = MISMATCH;
+                    return;
+                }
+
+                fs::create_directories(target.parent_path());
+                const auto staged = staged_of(delta);
+                if (delta.kind == Kind::SYMLINK) {
+                    fs::remove(staged);
+                    fs::create_symlink(delta.payload, staged);
+                    return;
+                }
+                const auto result = decode(delta.payload, delta.kind == Kind::CHANGED ? current->data : std::string{},
+                                           delta.result_size, codec_);
+                if (XXH64::hash(std::as_bytes(std::span(result))) != delta.result_hash) {
+                    throw std::runtime_error(std::format("delta for {} decodes to the wrong content", delta.path));
+                }
+                {
+                    std::ofstream out(staged, std::ios::binary | std::ios::trunc);
+                    out.write(result.data(), static_cast<std::streamsize>(result.size()));
+                    if (!out) throw std::runtime_error(std::format("cannot write {}", staged.string()));
+                }
+                fs::permissions(staged, static_cast<fs::perms>(delta.mode));
+            });
+        } catch (...) {
+            discard();
+            throw;
+        }
+
+        if (std::ranges::contains(outcomes, MISMATCH)) {
+            discard();
+            return false;
+        }
+        for (std::size_t i = 0; i < files_.size(); ++i) {
+            if (outcomes[i] == CURRENT) continue;
+            if (files_[i].kind == Kind::REMOVED) fs::remove(target_of(files_[i]));
+            else fs::rename(staged_of(files_[i]), target_of(files_[i]));
+        }
+        return true;
+    }
+
+    [[nodiscard]] const Identity& identity() const noexcept { return identity_; }
+    [[nodiscard]] const std::vector<FileDelta>& files() const noexcept { return files_; }
+    [[nodiscard]] double build_seconds() const noexcept { return build_seconds_; }
+
+    [[nodiscard]] std::uint64_t payload_bytes() const noexcept {
+        std::uint64_t total = 0;
+        for (const auto& delta : files_) total += delta.payload.size();
+        return total;
+    }
+
+    [[nodiscard]] std::uint64_t result_bytes() const noexcept {
+        std::uint64_t total = 0;
+        for (const auto& delta : files_) total += delta.result_size;
+        return total;
+    }
+
+private:
+    static constexpr std::string_view magic = "PPDELTA2"sv;
+    static constexpr std::uint8_t codec_raw = 0;
+    static constexpr std::uint8_t codec_zstd = 1;
+
+    /* a regular file's contents or a symlink's target; nothing else is packaged */
+    struct Entry {
+        std::string data;
+        bool link{false};
+    };
+
+    [[nodiscard]] static std::optional<Entry> read_entry(const fs::path& path) {
+        std::error_code ec;
+        const auto status = fs::symlink_status(path, ec);
+        if (fs::is_symlink(status)) {
+            auto target = fs::read_symlink(path, ec);
+            if (ec) return std::nullopt;
+            return Entry{target.string(), true};
+        }
+        if (!fs::is_regular_file(status)) return std::nullopt;
+        std::ifstream in(path, std::ios::binary);
+        if (!in) return std::nullopt;
+        return Entry{std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>())};
+    }
+
+    /* seeded apart, so a link never matches a file whose contents spell its target */
+    [[nodiscard]] static std::uint64_t entry_hash(const Entry& entry) noexcept {
+        return XXH64::hash(std::as_bytes(std::span(entry.data)), entry.link ? 1 : 0);
+    }
+
+    #ifdef PATCHER_HAVE_ZSTD
+    /* the window has to cover the whole stock file for it to be usable as a reference */
+    [[nodiscard]] static int window_log(std::size_t size) {
+        const auto bounds = ZSTD_cParam_getBounds(ZSTD_c_windowLog);
+        return std::clamp(static_cast<int>(std::bit_width(size)), bounds.lowerBound, bounds.upperBound);
+    }
+    #endif
+
+    [[nodiscard]] static std::string encode(const std::string& result, const std::string& stock,
+                                            std::uint8_t codec, int level) {
+        #ifdef PATCHER_HAVE_ZSTD
+        if (codec == codec_zstd) {
+            std::unique_ptr<ZSTD_CCtx, decltype(&ZSTD_freeCCtx)> cctx(ZSTD_createCCtx(), ZSTD_freeCCtx);
+            ZSTD_CCtx_setParameter(cctx.get(), ZSTD_c_compressionLevel, level);
+            ZSTD_CCtx_setParameter(cctx.get(), ZSTD_c_windowLog, window_log(std::max(stock.size(), result.size())));
+            ZSTD_CCtx_setParameter(cctx.get(), ZSTD_c_enableLongDistanceMatching, 1);
+            ZSTD_CCtx_refPrefix(cctx.get(), stock.data(), stock.size());
+
+            std::string frame(ZSTD_compressBound(result.size()), '\0');
+            const auto size = ZSTD_compress2(cctx.get(), frame.data(), frame.size(), result.data(), result.size());
+            if (ZSTD_isError(size)) {
+                throw std::runtime_error(std::format("zstd compression failed: {}", ZSTD_getErrorName(size)));
+            }
+            frame.resize(size);
+            return frame;
+        }
+        #else
+        (void)stock;
+        (void)codec;
+        (void)level;
+        #endif
+        return result;
+    }
+
+    [[nodiscard]] static std::string decode(const std::string& payload, const std::string& stock,
+                                            std::uint64_t result_size, std::uint8_t codec) {
+        #ifdef PATCHER_HAVE_ZSTD
+        if (codec == codec_zstd) {
+            std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)> dctx(ZSTD_createDCtx(), ZSTD_freeDCtx);
+            ZSTD_DCtx_setParameter(dctx.get(), ZSTD_d_windowLogMax, ZSTD_dParam_getBounds(ZSTD_d_windowLogMax).upperBound);
+            ZSTD_DCtx_refPrefix(dctx.get(), stock.data(), stock.size());
+
+            std::string result(result_size, '\0');
+            ZSTD_inBuffer input{payload.data(), payload.size(), 0};
+            ZSTD_outBuffer output{result.data(), result.size(), 0};
+            for (std::size_t status = 1; status != 0;) {
+                const auto progress = input.pos + output.pos;
+                status = ZSTD_decompressStream(dctx.get(), &output, &input);
+                if (ZSTD_isError(status)) {
+                    throw std::runtime_error(std::format("zstd decompression failed: {}", ZSTD_getErrorName(status)));
+                }
+                if (status != 0 && input.pos + output.pos == progress) {
+                    throw std::runtime_error("delta is truncated or larger than its recorded size");
+                }
+            }
+            if (output.pos != result.size()) throw std::runtime_error("delta decodes short of its recorded size");
+            return result;
+        }
+        #else
+        (void)stock;
+        (void)codec;
+        #endif
+        if (payload.size() != result_size) throw std::runtime_error("delta payload has the wrong size");
+        return payload;
+    }
+
+    Identity identity_;
+    double build_seconds_{0};
+    std::uint8_t codec_{codec_raw};
+    std::vector<FileDelta> files_;
+};
+
+class PortPatcher {
+public:
+	enum class BackupFormat : uint8_t { DIRECTORY, ARCHIVE };
+	enum class DeltaMode : uint8_t { NONE, EXPORT, IMPORT };
+
+	struct Config {
+		std::string port_name;
+		fs::path patch_file;
+		fs::path backup_dir;
+		fs::path ports_dir{"/usr/ports"};
+		bool dry_run{false};
+		bool force{false};
+		BackupFormat backup_format{BackupFormat::DIRECTORY};
+		fs::path bundle_cache; // compiled patch-series bundles, defaults to <backup_dir>/bundles
+		std::string make_flags; // GNU make jobserver flags handed down by RebuildScheduler
+		unsigned make_jobs{0}; // the scheduler's -jN share for ports that do not build with GNU make
+		unsigned threads{std::max(std::thread::hardware_concurrency(), 1u)}; // backup, restore, index and delta workers
+		DeltaMode delta_mode{DeltaMode::NONE};
+		fs::path delta_dir; // distribution point for delta packages, any local or mounted directory
+		fs::path delta_key; // signs exported deltas (private key) or checks imported ones (public key)
+		bool allow_unsigned_delta{false}; // import without a delta_key instead of building locally
+	};
+
+	struct BuildStats {
+		double seconds{0};
+		std::size_t max_rss_kb{0}; // whole build: the largest process's peak times the build's job count
+	};
+	
+	/* one phase interval, in seconds since the start of the run (or of the whole batch) */
+	struct PhaseSpan {
+		std::string name;
+		double start{0};
+		double end{0};
+	};
+
+	/* admission to the build phase, held until install finished; lets a scheduler run the
+	 * extract/backup/patch phases of other ports while this one builds. `acquire` is given the
+	 * jobserver tokens the build occupies by itself: one for a gmake build, whose other jobs
+	 * take their own tokens, or all of make_jobs for a build that cannot join the jobserver */
+	struct BuildGate {
+		std::function<Task<void>(unsigned tokens)> acquire;
+		std::function<void()> release;
+	};
+	
+	PortPatcher(Config config, Logger& logger):config_(std::move(config)),logger_(logger){}
+
+	[[nodiscard]] const std::optional<BuildStats>& build_stats() const noexcept { return build_stats_; }
+	[[nodiscard]] const std::vector<PhaseSpan>& phase_trace() const noexcept { return trace_; }
+	
+	[[nodiscard]] std::expected<void, std::string> run(){
+		EventLoop loop;
+		return loop.run_until_complete(run_async(loop));
+	}
+
+	[[nodiscard]] Task<std::expected<void, std::string>> run_async(EventLoop& loop, const BuildGate* gate = nullptr,
+	                                                             steady_clock::time_point epoch = steady_clock::now()) {
+		epoch_ = epoch;
+		trace_.clear();
+		std::expected<void, std::string> outcome;
+		try{
+			using enum PhaseCheckpoints::Phase;
+			logger_.info("starting  port patching for {}", config_.port_name);
+			verify_prerequisites();
+			create_backup_dir();
+
+			// a delta built elsewhere from the same stock package and patches replaces every phase
+			if (config_.delta_mode == DeltaMode::IMPORT && !config_.dry_run
+			    && co_await traced("import delta", import_delta(loop))) {
+				logger_.info("successfully patched {} from a delta package", config_.port_name);
+				log_trace();
+				co_return outcome;
+			}
+
+			PhaseCheckpoints checkpoints(config_.backup_dir / std::format("{}.checkpoint", config_.port_name));
+			if (config_.force) {
+				checkpoints.clear();
+			}
+			const auto inputs = co_await traced("hash inputs", loop.offload([this] { return phase_inputs(); }));
+			// offloaded: trusting INSTALLED means re-checking the installed files
+			const auto resume_at = co_await loop.offload([&] { return resume_point(checkpoints, inputs); });
+			const auto done = [&](PhaseCheckpoints::Phase phase) { return std::to_underlying(phase) < resume_at; };
+			if (resume_at > 0) {
+				logger_.info("resuming {} after phase '{}'", config_.port_name,
+					PhaseCheckpoints::phase_to_string(static_cast<PhaseCheckpoints::Phase>(resume_at - 1)));
+			}
+
+			// the patch is parsed while make fetches and unpacks the sources
+			auto validation = traced("validate patch", loop.offload([this] { validate_patch(); }));
+			std::string wrksrc;
+			if (done(EXTRACTED)) {
+				co_await validation;
+				wrksrc = checkpoints.detail(EXTRACTED);
+			} else {
+				wrksrc = (co_await when_all(traced("extract", extract_port(loop)), std::move(validation))).first;
+				checkpoints.mark(EXTRACTED, inputs, wrksrc);
+			}
+			const auto source_dir = config_.ports_dir / "x11" / config_.port_name / wrksrc;
+
+			// backup and bundle compilation each read the pristine tree on their own worker, side by side
+			std::optional<PatchBundle> bundle;
+			if (!done(BACKED_UP)) {
+				auto backup = traced("backup", loop.offload([&] { return backup_original(wrksrc); }));
+				fs::path backup_path;
+				if (is_series() && !done(PATCHED)) {
+					auto [path, compiled] = co_await when_all(std::move(backup),
+						traced("compile bundle", loop.offload([&] { return series_bundle(source_dir, false); })));
+					backup_path = std::move(path);
+					bundle.emplace(std::move(compiled));
+				} else {
+					backup_path = co_await backup;
+				}
+				checkpoints.mark(BACKED_UP, inputs, backup_path.string());
+			}
+
+			if (!done(PATCHED)) {
+				// resuming here, the tree may carry an older or half-applied patch
+				if (done(BACKED_UP)) {
+					const fs::path backup = checkpoints.detail(BACKED_UP);
+					co_await traced("restore", loop.offload([&] { restore_from_backup(source_dir, backup); }));
+					co_await clear_framework_cookies(loop);
+				}
+				co_await traced("patch", apply_patch(loop, source_dir, std::move(bundle)));
+				if (config_.dry_run) {
+					logger_.info("[DRY RUN] stopping before rebuild of {}", config_.port_name);
+					log_trace();
+					co_return outcome;
+				}
+				checkpoints.mark(PATCHED, inputs);
+			}
+			
+			if (!config_.dry_run && !(done(BUILT) && done(INSTALLED))) {
+				const bool gmake = !done(BUILT) && co_await joins_jobserver(loop);
+				const auto tokens = done(BUILT) || gmake ? 1u : std::max(config_.make_jobs, 1u);
+				if (gate) co_await traced("wait for build slot", gate->acquire(tokens));
+				const struct Release {
+					const BuildGate* gate;
+					~Release() { if (gate) gate->release(); }
+				} release{gate};
+
+				if (!done(BUILT)) {
+					co_await traced("build", build_port(loop, gmake));
+					checkpoints.mark(BUILT, inputs);
+				}
+				if (!done(INSTALLED)) {
+					// a valid checkpoint that did not count means the install drifted: put ours back
+					co_await traced("install", install_port(loop, checkpoints.valid(INSTALLED, inputs)));
+					checkpoints.mark(INSTALLED, inputs);
+				}
+			}
+			if (!config_.dry_run && !done(INSTALLED)) {
+				co_await traced("index install", loop.offload([this] { record_install_index(); }));
+			}
+			if (!config_.dry_run && config_.delta_mode == DeltaMode::EXPORT) {
+				co_await traced("export delta", export_delta(loop));
+			}
+			
+			logger_.info("successfully patched {}", config_.port_name);
+			
+		} catch (const std::exception& e){
+			outcome = std::unexpected(std::format("Operation failed: {}", e.what()));
+			}
+		log_trace();
+		co_return outcome;
+		}
+private:
+
+	void verify_prerequisites() const {
+		const auto port_dir = config_.ports_dir / "x11" / config_.port_name;
+		if(!fs::exists(port_dir)){
+			throw std::runtime_error(std::format("Port directory not found {}:, port_dir.string()));
+			}
+		if (!fs::exists(config_.patch_file)){
+			throw std::runtime_error(std::format("patch file not found: {}", config_.patch_file.string()));
+			}
+		logger_.debug("prerequisistes verified succeessfuly");
+	}
+	void create_backup_dir() const {
+		std::error_code ec;
+		fs::create_directories(config_.backup_dir, ec);
+		
+		if(ec){
+			throw std::runtime_error(std::format("failed to create backup directory: {}", ec.message()));
+			}
+		logger_.debug("Backup directory ready: {}", config_.backup_dir.string());
+	}
+	/* cumulative input hashes: each phase also depends on everything the phases before it consumed */
+	[[nodiscard]] PhaseCheckpoints::Inputs phase_inputs() const {
+		using enum PhaseCheckpoints::Phase;
+		const auto port_dir = config_.ports_dir / "x11" / config_.port_name;
+		PhaseCheckpoints::Inputs inputs{};
+		XXH64 hasher;
+
+		hash_file_into(hasher, port_dir / "Makefile");
+		hash_file_into(hasher, port_dir / "distinfo");
+		// options feed the build, but the framework's .configure_done/.build_done cookies live in
+		// WRKDIR, so new options only take effect after a `make clean extract`
+		hash_file_into(hasher, fs::path("/var/db/ports") / std::format("x11_{}", config_.port_name) / "options");
+		inputs[std::to_underlying(EXTRACTED)] = hasher.digest();
+		inputs[std::to_underlying(BACKED_UP)] = hasher.digest();
+
+		hash_file_into(hasher, config_.patch_file);
+		if (is_series()) {
+			for (const auto& patch : PatchBundle::read_series(config_.patch_file)) {
+				hash_file_into(hasher, patch);
+			}
+		}
+		inputs[std::to_underlying(PATCHED)] = hasher.digest();
+		inputs[std::to_underlying(BUILT)] = hasher.digest();
+		inputs[std::to_underlying(INSTALLED)] = hasher.digest();
+		return inputs;
+	}
+
+	/* index of the first phase that has to run again; a checkpoint whose work product is gone does not count */
+	[[nodiscard]] std::size_t resume_point(const PhaseCheckpoints& checkpoints,
+	                                       const PhaseCheckpoints::Inputs& inputs) const {
+		using enum PhaseCheckpoints::Phase;
+		const auto port_dir = config_.ports_dir / "x11" / config_.port_name;
+		std::size_t index = 0;
+		for (; index < PhaseCheckpoints::phase_count; ++index) {
+			const auto phase = static_cast<PhaseCheckpoints::Phase>(index);
+			if (!checkpoints.valid(phase, inputs)) break;
+			if (phase == EXTRACTED && !fs::exists(port_dir / checkpoints.detail(phase))) break;
+			if (phase == BACKED_UP && !fs::exists(checkpoints.detail(phase))) break;
+			if (phase == INSTALLED && !install_intact()) break;
+		}
+		return index;
+	}
+
+	/* whether the files we installed are still what the install index recorded; a same-version
+	 * `pkg install -f` or a base update puts stock files back behind the checkpoint */
+	[[nodiscard]] bool install_intact() const {
+		const auto index_path = install_index_path(config_);
+		auto index = InstallIndex::load(index_path);
+		if (!index) {
+			logger_.warning("{}: no install index, installing again", config_.port_name);
+			return false;
+		}
+		const auto report = index->verify(config_.threads);
+		if (!report.drifted.empty()) {
+			logger_.warning("{}: {} installed file(s) drifted since the last run, installing again",
+				config_.port_name, report.drifted.size());
+			return false;
+		}
+		index->save(index_path);
+		return true;
+	}
+
+	/* records when `task` ran; start it (or co_await it) at the moment the phase really begins */
+	template <typename T>
+	[[nodiscard]] Task<T> traced(std::string name, Task<T> task) {
+		const auto start = steady_clock::now();
+		const auto record = [&] {
+			trace_.push_back({std::move(name), duration<double>(start - epoch_).count(),
+				duration<double>(steady_clock::now() - epoch_).count()});
+		};
+		if constexpr (std::is_void_v<T>) {
+			co_await task;
+			record();
+		} else {
+			auto value = co_await task;
+			record();
+			co_return value;
+		}
+	}
+
+	void log_trace() const {
+		for (const auto& span : trace_) {
+			logger_.info("{} phase {:<20} {:8.3f}s .. {:8.3f}s ({:.3f}s)", config_.port_name, span.name,
+				span.start, span.end, span.end - span.start);
+		}
+	}
+
+	[[nodiscard]] std::vector<fs::path> patch_list() const {
+		return is_series() ? PatchBundle::read_series(config_.patch_file) : std::vector<fs::path>{config_.patch_file};
+	}
+
+	/* a series has to parse, since it is compiled into a bundle; a single patch goes to patch(1),
+	 * which accepts more than this parser (context diffs, mode-only git entries), so it only warns */
+	void validate_patch() const {
+		const auto patches = patch_list();
+		try {
+			const auto file_patches = PatchBundle::validate(patches);
+			logger_.debug("{} patch(es) parsed, {} file patches", patches.size(), file_patches);
+		} catch (const std::exception& e) {
+			if (is_series()) throw;
+			logger_.warning("{} did not parse ({}), leaving it to patch(1)", config_.patch_file.string(), e.what());
+		}
+	}
+
+	Task<std::string> extract_port(EventLoop& loop){
+		logger_.info("Extracting port sources...");
+		const auto port_dir= config_.ports_dir / "x11" / config_.port_name;
+		
+		// start from a pristine tree, a previous run may have left it patched or half-built
+		auto result = co_await loop.execute(
+			std::format("cd {} && make clean extract", port_dir.string()), logger_);
+		
+		if (result.status != 0 ) {
+			throw std::runtime_error("make extract failed");
+		}
+		
+		// get wrksrc directory
+		auto wrksrc = co_await loop.execute(std::format("cd {} && make -V WRKSRC", port_dir.string()), logger_);
+		auto dir = chomp(std::move(wrksrc.output));
+		if (wrksrc.status != 0 || dir.empty()){
+			throw std::runtime_error(std::format("failed to get WRKSRC: status {}", wrksrc.status));
+			}
+		co_return dir;
+	}
+
+	/* the restored WRKSRC is the pristine extract again, but the framework's patch, configure,
+	 * build, stage and install cookies in WRKDIR would still skip those steps; drop them (and
+	 * the staged tree, as `make restage` does) so the next build starts over from patching */
+	Task<void> clear_framework_cookies(EventLoop& loop) {
+		const auto port_dir = config_.ports_dir / "x11" / config_.port_name;
+		auto wrkdir = co_await loop.execute(std::format("cd {} && make -V WRKDIR -V STAGEDIR", port_dir.string()), logger_);
+		std::istringstream lines(wrkdir.output);
+		fs::path dir, stage_dir;
+		lines >> dir >> stage_dir;
+		if (wrkdir.status != 0 || dir.empty()) {
+			throw std::runtime_error(std::format("failed to get WRKDIR: status {}", wrkdir.status));
+		}
+
+		std::error_code ec;
+		for (const auto& item : fs::directory_iterator(dir, ec)) {
+			const auto name = item.path().filename().string();
+			if (name.starts_with('.') && name.contains("_done.") && !name.starts_with(".extract_done.")) {
+				fs::remove(item.path(), ec);
+				logger_.debug("removed framework cookie {}", name);
+			}
+		}
+		if (!stage_dir.empty()) fs::remove_all(stage_dir, ec);
+	}
+
+	fs::path backup_original(const std::string& wrksrc){
+		logger_.info("Backing up original source files...");
+		const auto port_dir= config_.ports_dir / "x11" / config_.port_name;
+		
+		fs::path source_dir = port_dir / wrksrc;
+		fs::path backup_path = config_.backup_dir / 
+			std::format("{}-original-{}", config_.port_name, get_timestamp());
+
+		if (config_.backup_format == BackupFormat::ARCHIVE) {
+			backup_path += BackupArchive::extension;
+			const auto stats = BackupArchive::create(source_dir, backup_path, config_.threads);
+			logger_.info("backup archive created at: {} ({} files, {} -> {} bytes, ratio {:.2f}, {:.1f} MiB/s)",
+				backup_path.string(), stats.files, stats.raw_bytes, stats.stored_bytes,
+				static_cast<double>(stats.raw_bytes) / static_cast<double>(std::max<std::uint64_t>(stats.stored_bytes, 1)),
+				static_cast<double>(stats.raw_bytes) / (1024.0 * 1024.0) / std::max(stats.elapsed.count(), 1e-9));
+			return backup_path;
+		}
+		
+		// copy directory  using modern filesystem operations
+		std::error_code ec;
+		fs::copy(source_dir, backup_path, fs::copy_options::recursive | fs::copy_options::copy_symlinks, ec);
+		
+		if (ec){
+			throw std::runtime_error(std::format("backup failed: {}", ec.message()));
+		}
+		
+		logger_.info("backup created at: {}", backup_path.string());
+		return backup_path;
+		}
+		[[nodiscard]] bool is_series() const {
+			return config_.patch_file.extension() == ".series";
+		}
+
+		/* loads the cached bundle for this port version and series, compiling it against the
+		 * pristine tree on a miss; `fresh` skips the cache */
+		[[nodiscard]] PatchBundle series_bundle(const fs::path& source_dir, bool fresh) {
+			const auto port_dir = config_.ports_dir / "x11" / config_.port_name;
+			const auto series = PatchBundle::read_series(config_.patch_file);
+			auto version = CommandExecutor::execute_with_output(
+				std::format("cd {} && make -V PKGVERSION", port_dir.string()), logger_);
+			if (!version) {
+				throw std::runtime_error(std::format("failed to get PKGVERSION: {}", version.error()));
+			}
+
+			const auto cache_dir = config_.bundle_cache.empty() ? config_.backup_dir / "bundles" : config_.bundle_cache;
+			const auto bundle_path = cache_dir / std::format("{}-{}-{:016x}{}", config_.port_name, *version,
+				PatchBundle::series_hash(series), PatchBundle::extension);
+			if (!fresh && fs::exists(bundle_path)) {
+				logger_.debug("using cached patch bundle {}", bundle_path.string());
+				return PatchBundle::load(bundle_path);
+			}
+
+			logger_.info("compiling {} patches into {}", series.size(), bundle_path.string());
+			auto bundle = PatchBundle::compile(series, source_dir, std::move(*version));
+			fs::create_directories(cache_dir);
+			bundle.save(bundle_path);
+			return bundle;
+		}
+
+		/* `compiled` is the bundle built alongside the backup, if there was one */
+		void apply_series(const fs::path& source_dir, std::optional<PatchBundle> compiled){
+			auto bundle = compiled ? std::move(*compiled) : series_bundle(source_dir, false);
+			if (config_.dry_run){
+				logger_.info("[DRY RUN] would apply bundle touching {} files", bundle.files().size());
+				return;
+			}
+
+			try {
+				if (!bundle.apply(source_dir)) {
+					logger_.warning("cached bundle does not match the extracted tree, recompiling");
+					bundle = series_bundle(source_dir, true);
+					if (!bundle.apply(source_dir)) {
+						throw std::runtime_error("extracted tree changed while compiling the bundle");
+					}
+				}
+			} catch (const std::exception& e) {
+				logger_.error("bundle failed ({})! attempting restore...", e.what());
+				restore_from_backup(source_dir);
+				throw std::runtime_error("patch application failed");
+			}
+			logger_.info("applied bundle touching {} files", bundle.files().size());
+		}
+
+		Task<void> apply_patch(EventLoop& loop, fs::path source_dir, std::optional<PatchBundle> bundle){
+			logger_.info("applying patch {}", config_.patch_file.string());
+			if (is_series()) {
+				co_await loop.offload([&] { apply_series(source_dir, std::move(bundle)); });
+				co_return;
+			}
+			const auto patch_cmd = std::format("cd {} && patch -p1 < {}", source_dir.string(), config_.patch_file.string());
+		
+		if (config_.dry_run){
+			logger_.info("[DRY RUN] would execute: {}", patch_cmd);
+			co_return;
+		}
+		
+		auto result = co_await loop.execute(patch_cmd, logger_);
+		if (result.status != 0) { 
+			logger_.error("patch failed! attempting restore...");
+			co_await loop.offload([&] { restore_from_backup(source_dir); });
+			throw std::runtime_error("patch application failed");
+			}
+		}
+		/* restores `backup`, or the newest backup of this port when none is given */
+		void restore_from_backup(const fs::path& target_dir, fs::path backup = {}) {
+        if (backup.empty()) {
+            backup = latest_backup();
+        }
+        logger_.info("Restoring from backup: {}", backup.string());
+
+        // open the backup before anything is deleted, so a missing or corrupt one leaves the tree alone
+        std::optional<BackupArchive> archive;
+        if (fs::is_regular_file(backup) && backup.extension() == BackupArchive::extension) {
+            archive.emplace(backup);
+        } else if (!fs::is_directory(backup)) {
+            throw std::runtime_error(std::format("Backup {} not found", backup.string()));
+        }
+        
+        // Clear target directory using modern filesystem operations
+        std::error_code ec;
+        for (const auto& entry : fs::directory_iterator(target_dir)) {
+            fs::remove_all(entry.path(), ec);
+            if (ec) {
+                logger_.warning("Failed to remove {}: {}", entry.path().string(), ec.message());
+            }
+        }
+
+        if (archive) {
+            const auto start = steady_clock::now();
+            archive->extract_all(target_dir, config_.threads);
+            logger_.info("restored {} in {:.3f}s", target_dir.string(),
+                duration<double>(steady_clock::now() - start).count());
+            return;
+        }
+        
+        // Copy with modern recursive iterator
+        for (const auto& entry : fs::recursive_directory_iterator(backup)) {
+            const auto relative = fs::relative(entry.path(), backup);
+            const auto dest = target_dir / relative;
+            
+            if (fs::is_directory(entry.status())) {
+                fs::create_directories(dest, ec);
+            } else {
+                fs::copy_file(entry.path(), dest, fs::copy_options::overwrite_existing, ec);
+            }
+            
+            if (ec) {
+                throw std::runtime_error(std::format("Restore failed during copy: {}", ec.message()));
+            }
+        }
+    }
+
+    [[nodiscard]] fs::path latest_backup() const {
+        // Find backups using modern ranges
+        auto backups = fs::directory_iterator(config_.backup_dir)
+            | std::views::filter([this](const auto& entry) {
+                return entry.path().string().contains(config_.port_name + "-original-")
+                    && entry.path().extension() != ".tmp";
+            })
+            | std::ranges::to<std::vector>();
+        
+        if (backups.empty()) {
+            throw std::runtime_error("No backup found to restore from");
+        }
+        
+        // Sort by modification time
+        std::ranges::sort(backups, [](const auto& a, const auto& b) {
+            return fs::last_write_time(a) > fs::last_write_time(b);
+        });
+        
+        return backups.front().path();
+    }
+
+    /* scheduled gmake ports share the batch's jobserver; false when not scheduled at all */
+    Task<bool> joins_jobserver(EventLoop& loop) {
+        if (config_.make_flags.empty()) co_return false;
+        const auto port_dir = config_.ports_dir / "x11" / config_.port_name;
+        const auto uses = co_await loop.execute(std::format("cd {} && make -V USES", port_dir.string()), logger_);
+        if (uses.status != 0) {
+            throw std::runtime_error("make -V USES failed");
+        }
+        co_return uses_gmake(uses.output);
+    }
+
+    Task<void> build_port(EventLoop& loop, bool gmake) {
+        logger_.info("Rebuilding port with patch...");
+        
+        const auto port_dir = config_.ports_dir / "x11" / config_.port_name;
+        const auto make_conf = fs::temp_directory_path() / std::format("port_patcher-{}-{}.make.conf", config_.port_name, getpid());
+        const struct Discard {
+            const fs::path& path;
+            ~Discard() {
+                std::error_code ec;
+                fs::remove(path, ec);
+            }
+        } discard{make_conf};
+
+        auto build_cmd = std::format("cd {} && make build", port_dir.string());
+        const auto jobs = std::max(config_.make_jobs, 1u);
+        if (!config_.make_flags.empty()) {
+            if (gmake) {
+                // only GNU make joins the jobserver. do-build runs under `env -i` with nothing but
+                // MAKE_ENV, so the flags are appended to MAKE_ENV from a make.conf overlay (which
+                // keeps the port's own MAKE_ENV) and the framework's -jN is switched off
+                write_jobserver_conf(make_conf);
+                build_cmd = std::format("cd {} && make __MAKE_CONF={} DISABLE_MAKE_JOBS=yes build",
+                                        port_dir.string(), make_conf.string());
+            } else {
+                // bmake, ninja, cargo and friends build with the framework's -jN at our share
+                build_cmd = std::format("cd {} && make MAKE_JOBS_NUMBER={} build", port_dir.string(), jobs);
+            }
+        }
+        
+        const auto result = co_await loop.execute(build_cmd, logger_);
+        if (result.status != 0) {
+            throw std::runtime_error("make build failed");
+        }
+
+        // wait4() only reports the largest single process, while up to `jobs` compilers ran side by side
+        build_stats_ = BuildStats{result.elapsed.count(), result.max_rss_kb * jobs};
+        logger_.info("rebuild took {:.1f}s, peak RSS {} KiB per process, about {} KiB over {} jobs",
+            build_stats_->seconds, result.max_rss_kb, build_stats_->max_rss_kb, jobs);
+    }
+
+    /* the user's make.conf plus GNUMAKEFLAGS in MAKE_ENV; sys.mk reads it in place of /etc/make.conf */
+    void write_jobserver_conf(const fs::path& file) const {
+        std::ofstream out(file, std::ios::trunc);
+        std::println(out, ".if exists(/etc/make.conf)");
+        std::println(out, ".include \"/etc/make.conf\"");
+        std::println(out, ".endif");
+        std::println(out, "MAKE_ENV+=\tGNUMAKEFLAGS=\"{}\"", config_.make_flags);
+        if (!out) throw std::runtime_error(std::format("cannot write {}", file.string()));
+        logger_.debug("gmake jobserver passed through {}", file.string());
+    }
+
+    /* `make -V USES` lists features, optionally with arguments, as in "gmake:lite" */
+    [[nodiscard]] static bool uses_gmake(const std::string& uses) {
+        std::istringstream words(uses);
+        for (std::string word; words >> word;) {
+            if (word == "gmake" || word.starts_with("gmake:")) return true;
+        }
+        return false;
+    }
+
+    Task<void> install_port(EventLoop& loop, bool reinstall = false) {
+        logger_.info("Installing patched port...");
+
+        const auto port_dir = config_.ports_dir / "x11" / config_.port_name;
+        const auto result = co_await loop.execute(
+            std::format("cd {} && make {}", port_dir.string(), reinstall ? "reinstall" : "install"), logger_);
+        if (result.status != 0) {
+            throw std::runtime_error("make install failed");
+        }
+    }
+
+    [[nodiscard]] std::expected<std::vector<std::string>, std::string> installed_files() {
+        auto files = CommandExecutor::execute_with_output(
+            std::format("pkg info -q -l -O x11/{}", config_.port_name), logger_);
+        if (!files) return std::unexpected(files.error());
+
+        std::vector<std::string> paths;
+        for (const auto line : *files | std::views::split('\n')) {
+            if (!line.empty()) paths.emplace_back(line.begin(), line.end());
+        }
+        return paths;
+    }
+
+    /* snapshot of what we just installed, checked later by --verify */
+    void record_install_index() {
+        auto paths = installed_files();
+        if (!paths) {
+            logger_.warning("cannot list installed files, drift detection disabled: {}", paths.error());
+            return;
+        }
+        record_install_index(std::move(*paths));
+    }
+
+    void record_install_index(std::vector<std::string> paths) {
+        const auto index = InstallIndex::build(std::move(paths), config_.threads);
+        index.save(install_index_path(config_));
+        logger_.info("recorded {} installed files for drift detection", index.size());
+    }
+
+    [[nodiscard]] static std::string chomp(std::string text) {
+        while (!text.empty() && (text.back() == '\n' || text.back() == '\r')) {
+            text.pop_back();
+        }
+        return text;
+    }
+
+    Task<DeltaPackage::Identity> delta_identity(EventLoop& loop) {
+        const auto port_dir = config_.ports_dir / "x11" / config_.port_name;
+        auto [version, abi] = co_await when_all(
+            loop.execute(std::format("cd {} && make -V PKGVERSION", port_dir.string()), logger_),
+            loop.execute("pkg config abi", logger_));
+        if (version.status != 0 || abi.status != 0) {
+            throw std::runtime_error("cannot determine PKGVERSION and ABI for the delta package");
+        }
+        // content-only patch hash: importers keep their patches wherever they like
+        co_return DeltaPackage::Identity{config_.port_name, chomp(std::move(version.output)),
+                                         chomp(std::move(abi.output)), PatchBundle::series_hash(patch_list())};
+    }
+
+    /* false when nothing matching is published, or the installed files are not the stock ones the
+     * delta was built against; the caller then builds locally */
+    Task<bool> import_delta(EventLoop& loop) {
+        const auto identity = co_await delta_identity(loop);
+        const auto path = config_.delta_dir / DeltaPackage::file_name(identity);
+        if (!fs::exists(path)) {
+            logger_.info("no delta {} published, building {} locally", path.string(), config_.port_name);
+            co_return false;
+        }
+
+        if (config_.delta_key.empty()) {
+            if (!config_.allow_unsigned_delta) {
+                logger_.warning("no delta key configured to check {}, building {} locally", path.string(), config_.port_name);
+                co_return false;
+            }
+            logger_.warning("no delta key configured, {} is not signature checked", path.string());
+        } else {
+            const auto verified = co_await loop.execute(std::format("openssl dgst -sha256 -verify {} -signature {}.sig {}",
+                config_.delta_key.string(), path.string(), path.string()), logger_);
+            if (verified.status != 0) {
+                throw std::runtime_error(std::format("signature check of {} failed", path.string()));
+            }
+        }
+
+        const auto start = steady_clock::now();
+        const auto package = co_await loop.offload([&] { return DeltaPackage::load(path); });
+        const bool applied = co_await loop.offload([&] {
+            return package.apply("/", config_.threads);
+        });
+        if (!applied) {
+            logger_.warning("installed {} is not the stock package {} was built against, building locally",
+                config_.port_name, path.filename().string());
+            co_return false;
+        }
+        logger_.info("applied {} ({} files, {} bytes for {} installed bytes) in {:.2f}s, rebuild took {:.1f}s on the exporting host",
+            path.filename().string(), package.files().size(), fs::file_size(path), package.result_bytes(),
+            duration<double>(steady_clock::now() - start).count(), package.build_seconds());
+
+        std::vector<std::string> paths;
+        for (const auto& delta : package.files()) {
+            if (delta.kind != DeltaPackage::Kind::REMOVED) paths.push_back(delta.path);
+        }
+        co_await loop.offload([&] { record_install_index(std::move(paths)); });
+        co_return true;
+    }
+
+    /* diffs what was just installed against the repository's stock package and publishes the
+     * result, signed when a key is configured */
+    Task<void> export_delta(EventLoop& loop) {
+        auto identity = co_await delta_identity(loop);
+        const auto stock_dir = fs::temp_directory_path() / std::format("port_patcher-stock-{}-{}", config_.port_name, getpid());
+        const struct Discard {
+            const fs::path& path;
+            ~Discard() {
+                std::error_code ec;
+                fs::remove_all(path, ec);
+            }
+        } discard{stock_dir};
+        fs::remove_all(stock_dir);
+        fs::create_directories(stock_dir / "root");
+
+        // the repository package is the stock build the importing hosts have installed
+        const auto fetched = co_await loop.execute(
+            std::format("pkg fetch -y -q -o {} x11/{}", stock_dir.string(), config_.port_name), logger_);
+        fs::path stock_package;
+        for (const auto& item : fs::recursive_directory_iterator(stock_dir)) {
+            if (item.path().extension() == ".pkg") stock_package = item.path();
+        }
+        if (fetched.status != 0 || stock_package.empty()) {
+            throw std::runtime_error(std::format("cannot fetch the stock package of {}", config_.port_name));
+        }
+        // the repository may lag or lead the ports tree; a delta against another version fits no importer
+        const auto stock_version = co_await loop.execute(std::format("pkg query -F {} %v", stock_package.string()), logger_);
+        if (stock_version.status != 0 || chomp(stock_version.output) != identity.version) {
+            throw std::runtime_error(std::format("repository has {} {}, but the ports tree builds {}", config_.port_name,
+                chomp(stock_version.output), identity.version));
+        }
+        const auto unpacked = co_await loop.execute(
+            std::format("tar -xf {} -C {}", stock_package.string(), (stock_dir / "root").string()), logger_);
+        if (unpacked.status != 0) {
+            throw std::runtime_error(std::format("cannot unpack {}", stock_package.string()));
+        }
+
+        auto installed = co_await loop.offload([this] { return installed_files(); });
+        if (!installed) {
+            throw std::runtime_error(std::format("cannot list installed files: {}", installed.error()));
+        }
+
+        const auto build_seconds = build_stats_ ? build_stats_->seconds : 0.0;
+        const auto file = config_.delta_dir / DeltaPackage::file_name(identity);
+        const auto tmp = fs::path(file) += ".tmp";
+        const auto package = co_await loop.offload([&] {
+            auto package = DeltaPackage::create(std::move(identity), std::move(*installed), stock_dir / "root",
+                                                build_seconds, config_.threads);
+            fs::create_directories(config_.delta_dir);
+            package.save(tmp);
+            return package;
+        });
+
+        // signed next to the temporary, so readers never pair a new signature with an old package
+        const auto signature = fs::path(file) += ".sig";
+        if (config_.delta_key.empty()) {
+            logger_.warning("no delta key configured, {} is published unsigned", file.string());
+            fs::remove(signature);
+        } else {
+            const auto tmp_signature = fs::path(tmp) += ".sig";
+            const auto signed_ok = co_await loop.execute(std::format("openssl dgst -sha256 -sign {} -out {} {}",
+                config_.delta_key.string(), tmp_signature.string(), tmp.string()), logger_);
+            if (signed_ok.status != 0) {
+                fs::remove(tmp);
+                fs::remove(tmp_signature);
+                throw std::runtime_error(std::format("signing {} failed", file.string()));
+            }
+            fs::rename(tmp_signature, signature);
+        }
+        fs::rename(tmp, file);
+
+        const auto size = fs::file_size(file);
+        logger_.info("exported {}: {} files, {} bytes for {} installed bytes ({:.1f}%), rebuild took {:.1f}s",
+            file.filename().string(), package.files().size(), size, package.result_bytes(),
+            100.0 * static_cast<double>(size) / static_cast<double>(std::max<std::uint64_t>(package.result_bytes(), 1)),
+            build_seconds);
+    }
+
+public:
+    [[nodiscard]] static fs::path install_index_path(const Config& config) {
+        return config.backup_dir / std::format("{}.installed", config.port_name);
+    }
+
+private:
+    [[nodiscard]] static std::string get_timestamp() {
+        auto now = zoned_time{current_zone(), system_clock::now()};
+        return std::format("{:%Y%m%d-%H%M%S}", now);
+    }
+
+    Config config_;
+    Logger& logger_;
+    std::optional<BuildStats> build_stats_;
+    steady_clock::time_point epoch_;
+    std::vector<PhaseSpan> trace_;
+};
+
+// jobserver
+
+/* GNU make compatible token pool (--jobserver-auth=fifo:PATH); one token per CPU in the budget */
+class Jobserver {
+public:
+    Jobserver(unsigned tokens, Logger& logger) : tokens_(std::max(tokens, 1u)), logger_(logger) {
+        #ifdef __unix__
+        path_ = fs::temp_directory_path() / std::format("port_patcher-jobserver-{}", getpid());
+        fs::remove(path_);
+        if (mkfifo(path_.c_str(), 0600) != 0) {
+            throw std::runtime_error(std::format("mkfifo {} failed: {}", path_.string(), std::strerror(errno)));
+        }
+        // opened read-write so readers never see EOF while the pool is empty
+        fd_ = open(path_.c_str(), O_RDWR);
+        if (fd_ < 0) {
+            fs::remove(path_);
+            throw std::runtime_error(std::format("open {} failed: {}", path_.string(), std::strerror(errno)));
+        }
+        for (unsigned i = 0; i < tokens_; ++i) {
+            release();
+        }
+        logger_.debug("jobserver ready: {} tokens at {}", tokens_, path_.string());
+        #else
+        throw std::runtime_error("jobserver unsupported on this platform");
+        #endif
+    }
+
+    Jobserver(const Jobserver&) = delete;
+    Jobserver& operator=(const Jobserver&) = delete;
+
+    ~Jobserver() {
+        #ifdef __unix__
+        if (fd_ >= 0) close(fd_);
+        std::error_code ec;
+        fs::remove(path_, ec);
+        #endif
+    }
+
+    void acquire() {
+        #ifdef __unix__
+        char token;
+        while (read(fd_, &token, 1) != 1) {
+            if (errno != EINTR) throw std::runtime_error("jobserver read failed");
+        }
+        #endif
+    }
+
+    void release() {
+        #ifdef __unix__
+        const char token = '+';
+        while (write(fd_, &token, 1) != 1) {
+            if (errno != EINTR) throw std::runtime_error("jobserver write failed");
+        }
+        #endif
+    }
+
+    [[nodiscard]] std::string make_flags() const {
+        return std::format("-j{} --jobserver-auth=fifo:{}", tokens_, path_.string());
+    }
+
+private:
+    unsigned tokens_;
+    Logger& logger_;
+    fs::path path_;
+    int fd_{-1};
+};
+
+// build history
+
+/* past rebuild timings per port, used to estimate the cost of the next rebuild */
+class BuildHistory {
+public:
+    explicit BuildHistory(fs::path file) : file_(std::move(file)) {
+        std::ifstream in(file_);
+        std::string port;
+        PortPatcher::BuildStats stats;
+        while (in >> port >> stats.seconds >> stats.max_rss_kb) {
+            entries_[port] = stats;
+        }
+    }
+
+    [[nodiscard]] PortPatcher::BuildStats estimate(const std::string& port) const {
+        if (auto it = entries_.find(port); it != entries_.end()) return it->second;
+        if (entries_.empty()) return {};
+
+        // unknown ports are assumed to cost as much as the average known one
+        PortPatcher::BuildStats mean;
+        for (const auto& stats : entries_ | std::views::values) {
+            mean.seconds += stats.seconds;
+            mean.max_rss_kb += stats.max_rss_kb;
+        }
+        mean.seconds /= static_cast<double>(entries_.size());
+        mean.max_rss_kb /= entries_.size();
+        return mean;
+    }
+
+    void record(const std::string& port, const PortPatcher::BuildStats& sample) {
+        auto [it, inserted] = entries_.try_emplace(port, sample);
+        if (!inserted) {
+            // smooth out noisy builds, but follow version bumps within a few runs
+            it->second.seconds = (it->second.seconds + sample.seconds) / 2;
+            it->second.max_rss_kb = std::max(it->second.max_rss_kb, sample.max_rss_kb);
+        }
+    }
+
+    void save() const {
+        std::ofstream out(file_, std::ios::trunc);
+        for (const auto& [port, stats] : entries_) {
+            std::println(out, "{} {:.3f} {}", port, stats.seconds, stats.max_rss_kb);
+        }
+    }
+
+private:
+    fs::path file_;
+    std::unordered_map<std::string, PortPatcher::BuildStats> entries_;
+};
+
+// rebuild scheduler
+
+class RebuildScheduler {
+public:
+    struct Budget {
+        unsigned cpus{std::max(std::thread::hardware_concurrency(), 1u)};
+        std::size_t memory_kb{physical_memory_kb()};
+        unsigned preparing{2}; // ports in extract..patch at once, each with cpus / preparing worker threads
+    };
+
+    RebuildScheduler(Budget budget, BuildHistory& history, Logger& logger)
+        : budget_(budget), history_(history), logger_(logger) {}
+
+    [[nodiscard]] std::expected<void, std::string> run(std::vector<PortPatcher::Config> batch) {
+        try {
+            EventLoop loop;
+            Jobserver jobserver(budget_.cpus, logger_);
+
+            // ports that cannot join the jobserver get an even split of the CPUs instead
+            const auto share = std::max(budget_.cpus / static_cast<unsigned>(std::max<std::size_t>(batch.size(), 1)), 1u);
+            std::vector<Job> jobs;
+            for (auto& config : batch) {
+                config.make_flags = jobserver.make_flags();
+                config.make_jobs = share;
+                config.threads = std::max(budget_.cpus / std::max(budget_.preparing, 1u), 1u);
+                auto estimate = history_.estimate(config.port_name);
+                jobs.push_back({std::move(config), estimate});
+            }
+
+            // longest estimated build first, so the batch finishes close to its slowest port
+            std::ranges::sort(jobs, std::ranges::greater{}, [](const Job& job) { return job.estimate.seconds; });
+
+            // up to budget_.preparing ports extract, back up and patch at once; the build phase waits
+            // for a token and room in the memory budget, so the next ports' preparation overlaps
+            // the current builds
+            Batch state{loop, jobserver};
+            const auto epoch = steady_clock::now();
+            std::vector<Task<void>> ports;
+            for (auto& job : jobs) {
+                ports.push_back(run_port(state, job, epoch));
+                ports.back().start();
+            }
+            loop.run_until_complete(join(ports));
+            history_.save();
+            logger_.info("batch of {} port(s) finished in {:.1f}s", jobs.size(),
+                         duration<double>(steady_clock::now() - epoch).count());
+
+            if (!state.failures.empty()) {
+                std::string message = std::format("{} port(s) failed", state.failures.size());
+                for (const auto& failure : state.failures) {
+                    message += std::format("\n  {}", failure);
+                }
+                return std::unexpected(message);
+            }
+            return {};
+
+        } catch (const std::exception& e) {
+            return std::unexpected(std::format("Scheduling failed: {}", e.what()));
+        }
+    }
+
+private:
+    struct Job {
+        PortPatcher::Config config;
+        PortPatcher::BuildStats estimate;
+    };
+
+    struct Batch {
+        EventLoop& loop;
+        Jobserver& jobserver;
+        EventLoop::Signal freed{loop};
+        EventLoop::Signal prepared{loop};
+        std::vector<const Job*> waiting; // for a build slot, longest estimate first
+        unsigned preparing{0};
+        std::size_t building{0};
+        std::size_t memory_in_use{0};
+        std::vector<std::string> failures;
+    };
+
+    static Task<void> join(std::vector<Task<void>>& tasks) {
+        for (auto& task : tasks) {
+            co_await task;
+        }
+    }
+
+    Task<void> run_port(Batch& batch, const Job& job, steady_clock::time_point epoch) {
+        while (batch.preparing >= std::max(budget_.preparing, 1u)) {
+            co_await batch.prepared.wait();
+        }
+        ++batch.preparing;
+        // the slot is handed back once the port queues for its build, or ends without one
+        bool preparing = true;
+        const auto prepared = [&] {
+            if (!std::exchange(preparing, false)) return;
+            --batch.preparing;
+            batch.prepared.notify_all();
+        };
+
+        PortPatcher patcher(job.config, logger_);
+        unsigned tokens = 0;
+        const PortPatcher::BuildGate gate{
+            .acquire = [&](unsigned wanted) { prepared(); tokens = wanted; return admit(batch, job, wanted); },
+            .release = [&] { release(batch, job, tokens); },
+        };
+        const auto result = co_await patcher.run_async(batch.loop, &gate, epoch);
+        prepared();
+        if (!result) {
+            batch.failures.push_back(std::format("{}: {}", job.config.port_name, result.error()));
+        } else if (patcher.build_stats()) {
+            history_.record(job.config.port_name, *patcher.build_stats());
+        }
+    }
+
+    /* the first waiting job that fits the memory budget gets the slot; a lone build always fits */
+    [[nodiscard]] const Job* admissible(const Batch& batch) const {
+        const auto it = std::ranges::find_if(batch.waiting, [&](const Job* job) {
+            return batch.building == 0 || batch.memory_in_use + job->estimate.max_rss_kb <= budget_.memory_kb;
+        });
+        return it == batch.waiting.end() ? nullptr : *it;
+    }
+
+    Task<void> admit(Batch& batch, const Job& job, unsigned tokens) {
+        const auto position = std::ranges::upper_bound(batch.waiting, job.estimate.seconds, std::ranges::greater{},
+                                                       [](const Job* waiting) { return waiting->estimate.seconds; });
+        batch.waiting.insert(position, &job);
+        while (admissible(batch) != &job) {
+            co_await batch.freed.wait();
+        }
+        std::erase(batch.waiting, &job);
+        ++batch.building;
+        batch.memory_in_use += job.estimate.max_rss_kb;
+        // whoever queued behind this job may fit as well
+        batch.freed.notify_all();
+
+        // a gmake build's token stands in for the implicit one its top-level make holds; other
+        // builds hold one per job. Shares add up to at most the pool, so partial holders cannot deadlock
+        co_await batch.loop.offload([&] {
+            for (unsigned i = 0; i < tokens; ++i) batch.jobserver.acquire();
+        });
+        logger_.info("scheduling build of {} (estimated {:.1f}s, {} KiB)",
+                     job.config.port_name, job.estimate.seconds, job.estimate.max_rss_kb);
+    }
+
+    void release(Batch& batch, const Job& job, unsigned tokens) {
+        for (unsigned i = 0; i < tokens; ++i) batch.jobserver.release();
+        --batch.building;
+        batch.memory_in_use -= job.estimate.max_rss_kb;
+        batch.freed.notify_all();
+    }
+
+    [[nodiscard]] static std::size_t physical_memory_kb() noexcept {
+        #ifdef __unix__
+        const long pages = sysconf(_SC_PHYS_PAGES);
+        const long page_size = sysconf(_SC_PAGESIZE);
+        if (pages > 0 && page_size > 0) {
+            return static_cast<std::size_t>(pages) / 1024 * static_cast<std::size_t>(page_size);
+        }
+        #endif
+        return std::numeric_limits<std::size_t>::max();
+    }
+
+    Budget budget_;
+    BuildHistory& history_;
+    Logger& logger_;
+};
+
+// backup benchmark
+
+/* archives `source_dir` into a scratch directory and reports ratio, throughput and restore latency */
+[[nodiscard]] std::expected<void, std::string> bench_backup(const fs::path& source_dir) {
+    try {
+        const auto scratch = fs::temp_directory_path() / std::format("port_patcher-bench-{}", getpid());
+        fs::create_directories(scratch);
+        const auto archive = scratch / std::format("bench{}", BackupArchive::extension);
+        const auto threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+        const auto stats = BackupArchive::create(source_dir, archive, threads);
+        const auto mib = static_cast<double>(stats.raw_bytes) / (1024.0 * 1024.0);
+        std::println("backup:       {} files, {:.1f} MiB -> {:.1f} MiB, ratio {:.2f}",
+                     stats.files, mib, static_cast<double>(stats.stored_bytes) / (1024.0 * 1024.0),
+                     static_cast<double>(stats.raw_bytes) / static_cast<double>(std::max<std::uint64_t>(stats.stored_bytes, 1)));
+        std::println("backup:       {:.3f}s, {:.1f} MiB/s on {} threads",
+                     stats.elapsed.count(), mib / std::max(stats.elapsed.count(), 1e-9), threads);
+
+        BackupArchive reader(archive);
+        auto start = steady_clock::now();
+        reader.extract_all(scratch / "tree", threads);
+        const duration<double> restore_all = steady_clock::now() - start;
+        std::println("restore all:  {:.3f}s, {:.1f} MiB/s", restore_all.count(), mib / std::max(restore_all.count(), 1e-9));
+
+        // sample up to 100 files spread across the archive
+        auto files = reader.entries()
+            | std::views::filter([](const auto& entry) { return entry.type == BackupArchive::EntryType::FILE; })
+            | std::ranges::to<std::vector>();
+        const auto step = std::max<std::size_t>(files.size() / 100, 1);
+        std::vector<double> latencies;
+        for (std::size_t i = 0; i < files.size(); i += step) {
+            start = steady_clock::now();
+            reader.extract_file(files[i].path, scratch / "single");
+            latencies.push_back(duration<double, std::micro>(steady_clock::now() - start).count());
+        }
+        if (!latencies.empty()) {
+            std::ranges::sort(latencies);
+            std::println("restore file: median {:.0f}us, max {:.0f}us over {} files",
+                         latencies[latencies.size() / 2], latencies.back(), latencies.size());
+        }
+
+        fs::remove_all(scratch);
+        return {};
+
+    } catch (const std::exception& e) {
+        return std::unexpected(std::format("Benchmark failed: {}", e.what()));
+    }
+}
+
+// log benchmark
+
+/* the same debug-heavy call pattern in text and binary mode, against an in-memory sink */
+void bench_log() {
+    constexpr int calls = 200'000;
+    for (const auto format : {Logger::Format::TEXT, Logger::Format::BINARY}) {
+        std::ostringstream sink;
+        Logger logger(sink, Logger::Level::DEBUG, format);
+        const auto start = steady_clock::now();
+        for (int i = 0; i < calls; ++i) {
+            logger.info("command output line {} of {}: {}", i, calls, "checking for working compiler... yes");
+        }
+        const duration<double, std::nano> elapsed = steady_clock::now() - start;
+        std::println("{:6}: {} bytes, {:.1f} bytes/call, {:.0f} ns/call",
+                     format == Logger::Format::TEXT ? "text" : "binary", sink.view().size(),
+                     static_cast<double>(sink.view().size()) / calls, elapsed.count() / calls);
+    }
+}
+
+// drift check
+
+/* keeps the ports whose installed files no longer match their install index; ports without an
+ * index are kept too, since nothing is known about them */
+[[nodiscard]] std::vector<PortPatcher::Config> select_drifted(std::vector<PortPatcher::Config> batch, Logger& logger) {
+    const auto threads = std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<PortPatcher::Config> drifted;
+    for (auto& config : batch) {
+        const auto index_path = PortPatcher::install_index_path(config);
+        auto index = InstallIndex::load(index_path);
+        if (!index) {
+            logger.warning("{}: no install index, queueing for re-patch", config.port_name);
+            config.force = true;
+            drifted.push_back(std::move(config));
+            continue;
+        }
+
+        const auto start = steady_clock::now();
+        const auto report = index->verify(threads);
+        logger.info("{}: {} files, {} re-hashed, {} unchanged by stat, {} drifted in {:.3f}s",
+                    config.port_name, index->size(), report.hashed, report.skipped, report.drifted.size(),
+                    duration<double>(steady_clock::now() - start).count());
+        if (report.drifted.empty()) {
+            index->save(index_path);
+            continue;
+        }
+
+        for (const auto& path : report.drifted) {
+            logger.debug("{}: drifted {}", config.port_name, path);
+        }
+        // the installed package was replaced behind our back, so every phase has to run again
+        config.force = true;
+        drifted.push_back(std::move(config));
+    }
+    return drifted;
+}
+
+struct PortSpec {
+    std::string port_name;
+    fs::path patch_file;
+};
+
+struct CLIArgs {
+    std::vector<PortSpec> ports;
+    fs::path backup_dir{"/usr/local/etc/patches"};
+    fs::path bench_dir;
+    fs::path bundle_cache;
+    PortPatcher::BackupFormat backup_format{PortPatcher::BackupFormat::DIRECTORY};
+    PortPatcher::DeltaMode delta_mode{PortPatcher::DeltaMode::NONE};
+    fs::path delta_dir;
+    fs::path delta_key;
+    bool allow_unsigned_delta{false};
+    unsigned jobs{0};
+    std::size_t memory_mb{0};
+    bool dry_run{false};
+    bool force{false};
+    bool verify{false};
+    bool binary_log{false};
+    bool bench_log{false};
+    bool verbose{false};
+    bool help{false};
+};
+
+[[nodiscard]] std::expected<CLIArgs, std::string> parse_args(std::span<const char*> args) {
+    CLIArgs cli_args;
+    
+    for (size_t i = 1; i < args.size(); ++i) {
+        std::string_view arg = args[i];
+        
+        if (arg == "--help" || arg == "-h") {
+            cli_args.help = true;
+        } else if (arg == "--dry-run" || arg == "-n") {
+            cli_args.dry_run = true;
+        } else if (arg == "--force" || arg == "-f") {
+            cli_args.force = true;
+        } else if (arg == "--binary-log") {
+            cli_args.binary_log = true;
+        } else if (arg == "--bench-log") {
+            cli_args.bench_log = true;
+        } else if (arg == "--verify") {
+            cli_args.verify = true;
+        } else if (arg == "--verbose" || arg == "-v") {
+            cli_args.verbose = true;
+        } else if (arg == "--backup-dir" || arg == "-b") {
+            if (++i >= args.size()) return std::unexpected("Missing backup directory");
+            cli_args.backup_dir = args[i];
+        } else if (arg == "--backup-format") {
+            if (++i >= args.size()) return std::unexpected("Missing backup format");
+            if (args[i] == "dir"sv) {
+                cli_args.backup_format = PortPatcher::BackupFormat::DIRECTORY;
+            } else if (args[i] == "archive"sv) {
+                cli_args.backup_format = PortPatcher::BackupFormat::ARCHIVE;
+            } else {
+                return std::unexpected(std::format("Unknown backup format: {}", args[i]));
+            }
+        } else if (arg == "--bundle-cache") {
+            if (++i >= args.size()) return std::unexpected("Missing bundle cache directory");
+            cli_args.bundle_cache = args[i];
+        } else if (arg == "--export-delta" || arg == "--import-delta") {
+            if (++i >= args.size()) return std::unexpected("Missing delta directory");
+            cli_args.delta_mode = arg == "--export-delta" ? PortPatcher::DeltaMode::EXPORT : PortPatcher::DeltaMode::IMPORT;
+            cli_args.delta_dir = args[i];
+        } else if (arg == "--delta-key") {
+            if (++i >= args.size()) return std::unexpected("Missing delta key");
+            cli_args.delta_key = args[i];
+        } else if (arg == "--allow-unsigned-delta") {
+            cli_args.allow_unsigned_delta = true;
+        } else if (arg == "--bench-backup") {
+            if (++i >= args.size()) return std::unexpected("Missing benchmark directory");
+            cli_args.bench_dir = args[i];
+        } else if (arg == "--jobs" || arg == "-j") {
+            if (++i >= args.size()) return std::unexpected("Missing job count");
+            cli_args.jobs = static_cast<unsigned>(std::stoul(args[i]));
+        } else if (arg == "--memory" || arg == "-m") {
+            if (++i >= args.size()) return std::unexpected("Missing memory budget");
+            cli_args.memory_mb = std::stoull(args[i]);
+        } else if (!arg.starts_with('-')) {
+            if (cli_args.ports.empty() || !cli_args.ports.back().patch_file.empty()) {
+                cli_args.ports.push_back({.port_name = std::string(arg)});
+            } else {
+                cli_args.ports.back().patch_file = arg;
+            }
+        } else {
+            return std::unexpected(std::format("Unknown argument: {}", arg));
+        }
+    }
+    
+    if (cli_args.help || cli_args.bench_log || !cli_args.bench_dir.empty()) return cli_args;
+    if (cli_args.ports.empty()) return std::unexpected("Port name required");
+    if (cli_args.ports.back().patch_file.empty()) return std::unexpected("Patch file required");
+    
+    return cli_args;
+}
+
+void print_usage(std::string_view program_name) {
+    std::print("Usage: {} <port-name> <patch-file> [<port-name> <patch-file>...] [options]\n", program_name);
+    std::print("A patch file ending in .series lists patches to stack, one per line.\n");
+    std::print("Options:\n");
+    std::print("  -h, --help           Show this help message\n");
+    std::print("  -n, --dry-run        Don't actually apply changes\n");
+    std::print("  -f, --force          Ignore phase checkpoints and start from make extract\n");
+    std::print("  --binary-log         Write a binary log to /var/log/port_patcher-*.plog (see port_logdecode)\n");
+    std::print("  --bench-log          Report bytes and ns per call for text and binary logging\n");
+    std::print("  --verify             Only re-patch ports whose installed files drifted\n");
+    std::print("  -v, --verbose        Enable verbose output\n");
+    std::print("  -b, --backup-dir DIR Specify backup directory\n");
+    std::print("  --backup-format FMT  'dir' (plain copy, default) or 'archive' (indexed zstd)\n");
+    std::print("  --bundle-cache DIR   Where compiled .series bundles are cached (may be shared)\n");
+    std::print("  --export-delta DIR   After installing, publish a delta against the stock package to DIR\n");
+    std::print("  --import-delta DIR   Apply a matching delta from DIR instead of building, if one exists\n");
+    std::print("  --delta-key FILE     PEM key that signs exported (private) or checks imported (public) deltas\n");
+    std::print("  --allow-unsigned-delta  Import deltas without a --delta-key to check them against\n");
+    std::print("  --bench-backup DIR   Report archive ratio, throughput and restore latency for DIR\n");
+    std::print("  -j, --jobs N         CPU tokens shared by all port builds (default: all cores)\n");
+    std::print("  -m, --memory MB      Memory budget for concurrent port builds (default: physical RAM)\n");
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        // Parse command line arguments
+        auto args = parse_args({argv, static_cast<size_t>(argc)});
+        if (!args) {
+            std::println(stderr, "Error: {}", args.error());
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        
+        if (args->help) {
+            print_usage(argv[0]);
+            return EXIT_SUCCESS;
+        }
+
+        if (args->bench_log) {
+            bench_log();
+            return EXIT_SUCCESS;
+        }
+
+        if (!args->bench_dir.empty()) {
+            auto result = bench_backup(args->bench_dir);
+            if (!result) {
+                std::println(stderr, "Error: {}", result.error());
+                return EXIT_FAILURE;
+            }
+            return EXIT_SUCCESS;
+        }
+        
+        // Initialize logging; site ids are per session, so every binary session gets its own file
+        // instead of interleaving with other runs appending to the text log
+        const fs::path log_path = args->binary_log
+            ? fs::path(std::format("/var/log/port_patcher-{:%Y%m%dT%H%M%S}-{}.plog", floor<seconds>(system_clock::now()), getpid()))
+            : fs::path("/var/log/port_patcher.log");
+        std::ofstream log_file(log_path, args->binary_log ? std::ios::app | std::ios::binary : std::ios::app);
+        Logger file_logger(log_file, args->verbose ? Logger::Level::DEBUG : Logger::Level::INFO,
+            args->binary_log ? Logger::Format::BINARY : Logger::Format::TEXT);
+        Logger console_logger(std::cout, args->verbose ? Logger::Level::DEBUG : Logger::Level::INFO);
+        
+        // Create and run patchers
+        std::vector<PortPatcher::Config> batch;
+        for (const auto& port : args->ports) {
+            batch.push_back({
+                .port_name = port.port_name,
+                .patch_file = port.patch_file,
+                .backup_dir = args->backup_dir,
+                .dry_run = args->dry_run,
+                .force = args->force,
+                .backup_format = args->backup_format,
+                .bundle_cache = args->bundle_cache,
+                .delta_mode = args->delta_mode,
+                .delta_dir = args->delta_dir,
+                .delta_key = args->delta_key,
+                .allow_unsigned_delta = args->allow_unsigned_delta
+            });
+        }
+
+        if (args->verify) {
+            batch = select_drifted(std::move(batch), console_logger);
+            if (batch.empty()) {
+                console_logger.info("No installed port has drifted");
+                return EXIT_SUCCESS;
+            }
+        }
+
+        RebuildScheduler::Budget budget;
+        if (args->jobs) budget.cpus = args->jobs;
+        if (args->memory_mb) budget.memory_kb = args->memory_mb * 1024;
+
+        fs::create_directories(args->backup_dir);
+        BuildHistory history(args->backup_dir / "build-times");
+        RebuildScheduler scheduler(budget, history, file_logger);
         
         if (args->dry_run) {
             console_logger.info("Running in dry-run mode");
         }
         
-        auto result = patcher.run();
+        auto result = scheduler.run(std::move(batch));
         if (!result) {
             console_logger.error("{}", result.error());
             return EXIT_FAILURE;
@@ -8,6 +8,7 @@ use Cwd 'abs_path';
 my $port_name = "st";                   # Port to patch (e.g., x11/st)
 my $patch_file = "/path/to/your/patch.diff";  # Path to your custom patch
 my $backup_dir = "/usr/local/etc/patches";    # Where to backup original files
+my $backup_format = "dir";                     # "dir" (plain copy) or "tar.zst" (multi-threaded zstd)
 
 # Create backup dir if missing
 mkdir -p $backup_dir or die "[-] Failed to create backup directory: $!\n";
@@ -23,8 +24,13 @@ my $wrksrc = `make -V WRKSRC`;
 chomp($wrksrc);
 $wrksrc = abs_path($wrksrc);
 
-dircopy($wrksrc, "$backup_dir/$port_name-original") or 
-    die "[-] Backup failed: $!\n";
+if ($backup_format eq "tar.zst") {
+    system("tar -C '$wrksrc' -cf - . | zstd -T0 -q -c > '$backup_dir/$port_name-original.tar.zst'") == 0 or
+        die "[-] Backup failed: $?\n";
+} else {
+    dircopy($wrksrc, "$backup_dir/$port_name-original") or 
+        die "[-] Backup failed: $!\n";
+}
 
 # Step 2: Apply your patch
 print "[+] Applying patch: $patch_file...\n";
@@ -32,8 +38,13 @@ chdir($wrksrc) or die "[-] Failed to change to WRKSRC directory: $!\n";
 
 if (system("patch -p1 < '$patch_file'") != 0) {
     print "[-] Patch failed! Restoring original files...\n";
-    dircopy("$backup_dir/$port_name-original", $wrksrc) or 
-        die "[-] Restore failed: $!\n";
+    if ($backup_format eq "tar.zst") {
+        system("zstd -T0 -q -dc '$backup_dir/$port_name-original.tar.zst' | tar -C '$wrksrc' -xf -") == 0 or
+            die "[-] Restore failed: $?\n";
+    } else {
+        dircopy("$backup_dir/$port_name-original", $wrksrc) or 
+            die "[-] Restore failed: $!\n";
+    }
     exit 1;
 }
 
@@ -7,6 +7,9 @@
 PORT_NAME="st"                  # Port to patch (e.g., x11/st)
 PATCH_FILE="/path/to/your/patch.diff"  # Path to your custom patch
 BACKUP_DIR="/usr/local/etc/patches"    # Where to backup original files
+BACKUP_FORMAT="dir"                    # "dir" (plain copy) or "tar.zst" (multi-threaded zstd)
+
+ARCHIVE="${BACKUP_DIR}/${PORT_NAME}-original.tar.zst"
 
 # Create backup dir if missing
 mkdir -p "$BACKUP_DIR"
@@ -17,14 +20,36 @@ cd "/usr/ports/x11/${PORT_NAME}" || exit 1
 # Step 1: Backup original files before patching
 echo "[+] Backing up original source files..."
 make extract
-cp -r "$(make -V WRKSRC)" "${BACKUP_DIR}/${PORT_NAME}-original"
+if [ "$BACKUP_FORMAT" = "tar.zst" ]; then
+    # sh only reports the last command of a pipeline, so tar records its own failure; the archive
+    # is written aside, tested and only then renamed over the previous backup
+    rm -f "${ARCHIVE}.tmp" "${ARCHIVE}.tar-failed"
+    { tar -C "$(make -V WRKSRC)" -cf - . || touch "${ARCHIVE}.tar-failed"; } | zstd -T0 -q -c > "${ARCHIVE}.tmp"
+    if [ $? -ne 0 ] || [ -e "${ARCHIVE}.tar-failed" ] || ! zstd -q -t "${ARCHIVE}.tmp"; then
+        echo "[-] Backup failed, keeping the previous one"
+        rm -f "${ARCHIVE}.tmp" "${ARCHIVE}.tar-failed"
+        exit 1
+    fi
+    mv "${ARCHIVE}.tmp" "$ARCHIVE" || exit 1
+else
+    cp -r "$(make -V WRKSRC)" "${BACKUP_DIR}/${PORT_NAME}-original"
+fi
 
 # Step 2: Apply your patch
 echo "[+] Applying patch: ${PATCH_FILE}..."
 cd "$(make -V WRKSRC)" || exit 1
 if ! patch -p1 < "$PATCH_FILE"; then
     echo "[-] Patch failed! Restoring original files..."
-    cp -r "${BACKUP_DIR}/${PORT_NAME}-original"/* .
+    if [ "$BACKUP_FORMAT" = "tar.zst" ]; then
+        rm -f "${ARCHIVE}.zstd-failed"
+        { zstd -T0 -q -dc "$ARCHIVE" || touch "${ARCHIVE}.zstd-failed"; } | tar -xf -
+        if [ $? -ne 0 ] || [ -e "${ARCHIVE}.zstd-failed" ]; then
+            rm -f "${ARCHIVE}.zstd-failed"
+            echo "[-] Restore failed, run 'make clean' before trying again"
+        fi
+    else
+        cp -r "${BACKUP_DIR}/${PORT_NAME}-original"/* .
+    fi
     exit 1
 fi
 